@@ -0,0 +1,377 @@
+/* bench.c  -- replay recorded inputs through the ja4plus callbacks
+ *
+ * Each op is one call sequence the way capture would make it, including
+ * the session save, so the numbers cover the per session state as well.
+ * The plugin is configured with -o key=value just like capture, for example
+ * -o ja4plusCertCacheSize=0 to measure JA4x without the cache. "fmt" times
+ * the formatting on its own against printf, see fmt.c.
+ *
+ * SPDX-License-Identifier: FoxIO License 1.1
+ */
+
+#include <getopt.h>
+#include <time.h>
+#include "mock.h"
+#include "inputs.h"
+#include "../parsers/ssh_info.h"
+
+#define BENCH_MAX_INPUTS 16
+
+typedef struct {
+    uint8_t           *data;
+    int                len;
+} BenchBuf_t;
+
+typedef struct {
+    ArkimePacket_t     packets[8];
+    int                num;
+    int                bytes;
+} BenchTCP_t;
+
+typedef struct {
+    const char        *name;
+    const char        *alias;
+    const char        *func;            // named func, NULL for ja4h
+    int              (*setup)();        // returns number of recorded inputs
+    int              (*run)(int i);     // returns bytes handed to the plugin
+} BenchCase_t;
+
+LOCAL void                *pluginData[1];
+LOCAL ArkimeSession_t      session;
+LOCAL ArkimeParserNamedFunc func;
+
+LOCAL int                  inputsNum;
+LOCAL BenchBuf_t           bufs[BENCH_MAX_INPUTS];
+LOCAL BenchTCP_t           tcps[BENCH_MAX_INPUTS];
+LOCAL http_parser          parsers[BENCH_MAX_INPUTS];
+LOCAL SSHInfo_t            sshs[BENCH_MAX_INPUTS];
+
+/******************************************************************************/
+LOCAL void bench_session_new()
+{
+    memset(&session, 0, sizeof(session));
+    pluginData[0] = NULL;
+    session.pluginData = pluginData;
+    session.ipProtocol = IPPROTO_TCP;
+    session.stopSaving = 0xffff;
+    session.firstPacket.tv_sec = 1700000000;
+}
+/******************************************************************************/
+LOCAL void bench_session_end()
+{
+    if (mockPreSave)
+        mockPreSave(&session, TRUE);
+    mockSave(&session, TRUE);
+}
+/******************************************************************************/
+LOCAL int bench_hex(const char *hex, uint8_t *out)
+{
+    int len = strlen(hex) / 2;
+    for (int i = 0; i < len; i++) {
+        sscanf(hex + i * 2, "%2hhx", &out[i]);
+    }
+    return len;
+}
+/******************************************************************************/
+LOCAL int bench_bufs_setup(const char **hexs)
+{
+    int i;
+    for (i = 0; hexs[i] && i < BENCH_MAX_INPUTS; i++) {
+        bufs[i].data = g_malloc(strlen(hexs[i]) / 2);
+        bufs[i].len = bench_hex(hexs[i], bufs[i].data);
+    }
+    return i;
+}
+/******************************************************************************/
+LOCAL int bench_ja4s_setup()
+{
+    return bench_bufs_setup(benchServerHellos);
+}
+/******************************************************************************/
+LOCAL int bench_ja4s_run(int i)
+{
+    BenchBuf_t *buf = &bufs[i % inputsNum];
+
+    bench_session_new();
+    func(&session, buf->data, buf->len, NULL);
+    bench_session_end();
+    return buf->len;
+}
+/******************************************************************************/
+LOCAL int bench_ja4x_setup()
+{
+    return bench_bufs_setup(benchCerts);
+}
+/******************************************************************************/
+LOCAL int bench_ja4x_run(int i)
+{
+    BenchBuf_t *buf = &bufs[i % inputsNum];
+
+    // Only passed through to arkime_field_certsinfo_update_extra
+    bench_session_new();
+    func(&session, buf->data, buf->len, buf);
+    bench_session_end();
+    return buf->len;
+}
+/******************************************************************************/
+LOCAL int bench_tcp_setup()
+{
+    int s;
+    for (s = 0; benchTCPSessions[s].name && s < BENCH_MAX_INPUTS; s++) {
+        const BenchTCPSession_t *rec = &benchTCPSessions[s];
+        BenchTCP_t              *tcp = &tcps[s];
+        int                      ipLen = rec->v6 ? 40 : 20;
+
+        for (tcp->num = 0; rec->packets[tcp->num].flags; tcp->num++) {
+            const BenchTCPPacket_t *p = &rec->packets[tcp->num];
+            ArkimePacket_t         *packet = &tcp->packets[tcp->num];
+
+            uint8_t *pkt = g_malloc0(ipLen + 60);
+            if (rec->v6)
+                ((struct ip6_hdr *)pkt)->ip6_hops = p->ttl;
+            else
+                ((struct ip *)pkt)->ip_ttl = p->ttl;
+
+            struct tcphdr *tcph = (struct tcphdr *)(pkt + ipLen);
+            int optLen = bench_hex(p->options, pkt + ipLen + 20);
+            optLen = (optLen + 3) & ~3;
+            tcph->th_off = (20 + optLen) / 4;
+            tcph->th_flags = p->flags;
+            tcph->th_win = htons(p->window);
+
+            packet->pkt = pkt;
+            packet->pktlen = ipLen + 20 + optLen + p->dataLen;
+            packet->ipOffset = 0;
+            packet->payloadOffset = ipLen;
+            packet->payloadLen = 20 + optLen + p->dataLen;
+            packet->direction = p->direction;
+            packet->v6 = rec->v6;
+            packet->ts.tv_sec = 1700000000 + p->usec / 1000000;
+            packet->ts.tv_usec = p->usec % 1000000;
+            tcp->bytes += ipLen + 20 + optLen;
+        }
+    }
+    return s;
+}
+/******************************************************************************/
+LOCAL int bench_tcp_run(int i)
+{
+    BenchTCP_t *tcp = &tcps[i % inputsNum];
+
+    bench_session_new();
+    for (int p = 0; p < tcp->num; p++) {
+        func(&session, NULL, 0, &tcp->packets[p]);
+    }
+    bench_session_end();
+    return tcp->bytes;
+}
+/******************************************************************************/
+LOCAL int bench_ja4h_setup()
+{
+    int r;
+    for (r = 0; benchHTTPRequests[r].name && r < BENCH_MAX_INPUTS; r++) {
+        parsers[r].type = 0; // HTTP_REQUEST
+        parsers[r].method = benchHTTPRequests[r].method;
+        parsers[r].http_major = benchHTTPRequests[r].major;
+        parsers[r].http_minor = benchHTTPRequests[r].minor;
+    }
+    return r;
+}
+/******************************************************************************/
+LOCAL int bench_ja4h_run(int i)
+{
+    int                       r = i % inputsNum;
+    const BenchHTTPRequest_t *rec = &benchHTTPRequests[r];
+    int                       bytes = 0;
+
+    bench_session_new();
+    for (int h = 0; rec->headers[h]; h += 2) {
+        int nameLen = strlen(rec->headers[h]);
+        int valueLen = strlen(rec->headers[h + 1]);
+
+        mockHeaderFieldRaw(&session, &parsers[r], rec->headers[h], nameLen);
+        mockHeaderValue(&session, &parsers[r], rec->headers[h + 1], valueLen);
+        bytes += nameLen + valueLen;
+    }
+    mockMessageComplete(&session, &parsers[r]);
+    bench_session_end();
+    return bytes;
+}
+/******************************************************************************/
+LOCAL int bench_ja4ssh_setup()
+{
+    int s;
+    for (s = 0; benchSSHSessions[s].name && s < BENCH_MAX_INPUTS; s++) {
+        const BenchSSHSession_t *rec = &benchSSHSessions[s];
+
+        sshs[s].packets200[0] = rec->clientPackets;
+        sshs[s].packets200[1] = 200 - rec->clientPackets;
+        for (int d = 0; d < 2; d++) {
+            for (int k = 0; k < sshs[s].packets200[d]; k++) {
+                sshs[s].lens[d][k] = rec->lens[d][k % 20];
+            }
+        }
+    }
+    return s;
+}
+/******************************************************************************/
+/* One 200 packet window per op, sessions last 100 windows */
+LOCAL int bench_ja4ssh_run(int i)
+{
+    int s = (i / 100) % inputsNum;
+
+    if (i % 100 == 0) {
+        if (i > 0)
+            bench_session_end();
+        bench_session_new();
+    }
+    session.tcpFlagAckCnt[0] = 60;
+    session.tcpFlagAckCnt[1] = 40;
+    func(&session, NULL, 0, &sshs[s]);
+    return sizeof(sshs[s].lens);
+}
+/******************************************************************************/
+LOCAL BenchCase_t cases[] = {
+    {"ja4s",   NULL,   "tls_process_server_hello",      bench_ja4s_setup,   bench_ja4s_run},
+    {"ja4x",   NULL,   "tls_process_certificate_wInfo", bench_ja4x_setup,   bench_ja4x_run},
+    {"ja4t",   "ja4l", "tcp_raw_packet",                bench_tcp_setup,    bench_tcp_run},
+    {"ja4h",   NULL,   NULL,                            bench_ja4h_setup,   bench_ja4h_run},
+    {"ja4ssh", NULL,   "ssh_counting200",               bench_ja4ssh_setup, bench_ja4ssh_run},
+};
+
+/******************************************************************************/
+LOCAL uint64_t bench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+/******************************************************************************/
+LOCAL void bench_run(BenchCase_t *c, int iterations)
+{
+    if (c->func) {
+        func = mock_named_func(c->func);
+        if (!func) {
+            printf("%-8s disabled\n", c->name);
+            return;
+        }
+    } else if (!mockMessageComplete) {
+        printf("%-8s disabled\n", c->name);
+        return;
+    }
+
+    int inputs = inputsNum = c->setup();
+
+    // Print what each recorded input produces, also warms the caches
+    for (int i = 0; i < inputs * 100; i++) {
+        if (mockVerbose && i < inputs)
+            printf("%s input %d\n", c->name, i);
+        c->run(i);
+        if (i == inputs - 1)
+            mockVerbose = 0;
+    }
+
+    uint64_t allocs = mockAllocs;
+    uint64_t fields = mockFieldAdds;
+    uint64_t bytes = 0;
+    uint64_t start = bench_now();
+    for (int i = 0; i < iterations; i++) {
+        bytes += c->run(i);
+    }
+    uint64_t ns = bench_now() - start;
+    allocs = mockAllocs - allocs;
+    fields = mockFieldAdds - fields;
+
+    // ja4ssh keeps the last session open between ops
+    if (c->run == bench_ja4ssh_run)
+        bench_session_end();
+
+    printf("%-8s %10d %10.1f %10.3f %10.2f %10.2f %10.1f\n",
+           c->name,
+           iterations,
+           (double)ns / iterations,
+           (double)allocs / iterations,
+           (double)fields / iterations,
+           iterations * 1000.0 / ns,
+           bytes * 1000.0 / ns);
+}
+/******************************************************************************/
+LOCAL void bench_usage(const char *prog)
+{
+    printf("%s [-n iterations] [-o key=value]... [-v] [fingerprint]...\n", prog);
+    printf("  fingerprints: ja4s ja4x ja4t (same callback as ja4l) ja4h ja4ssh, default all\n");
+    printf("  fmt: the fingerprint formatting against the printf it replaced\n");
+    exit(1);
+}
+/******************************************************************************/
+int main(int argc, char **argv)
+{
+    int iterations = 200000;
+    int verbose = 0;
+    int opt;
+
+    mock_init();
+
+    while ((opt = getopt(argc, argv, "n:o:vh")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'o':
+            mock_config_set(optarg);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            bench_usage(argv[0]);
+        }
+    }
+    if (iterations <= 0)
+        bench_usage(argv[0]);
+
+    int fmt = 0;
+    for (int a = optind; a < argc; a++) {
+        if (strcmp(argv[a], "fmt") == 0) {
+            fmt = 1;
+            continue;
+        }
+        int c;
+        for (c = 0; c < (int)(sizeof(cases) / sizeof(cases[0])); c++) {
+            if (strcmp(argv[a], cases[c].name) == 0 || (cases[c].alias && strcmp(argv[a], cases[c].alias) == 0))
+                break;
+        }
+        if (c == (int)(sizeof(cases) / sizeof(cases[0])))
+            bench_usage(argv[0]);
+    }
+
+    arkime_plugin_init();
+
+    // Only fmt asked for
+    if (fmt && argc - optind == 1) {
+        bench_fmt(iterations);
+        return 0;
+    }
+
+    printf("%-8s %10s %10s %10s %10s %10s %10s\n", "fp", "ops", "ns/op", "allocs/op", "fields/op", "Mops/s", "MB/s");
+    for (int c = 0; c < (int)(sizeof(cases) / sizeof(cases[0])); c++) {
+        if (optind < argc) {
+            int a;
+            for (a = optind; a < argc; a++) {
+                if (strcmp(argv[a], cases[c].name) == 0 || (cases[c].alias && strcmp(argv[a], cases[c].alias) == 0))
+                    break;
+            }
+            if (a == argc)
+                continue;
+        }
+        mockVerbose = verbose;
+        bench_run(&cases[c], iterations);
+    }
+
+    if (fmt)
+        bench_fmt(iterations);
+
+    if (mockExit)
+        mockExit();
+    return 0;
+}
@@ -0,0 +1,200 @@
+/* fmt.c  -- the ja4plus_fmt_* writers against the printf calls they replaced
+ *
+ * ja4plus.c is built as part of this file so its static writers can be
+ * called directly. Each row formats the same values both ways, the printf
+ * column is the code the writers replaced and the writers column is the
+ * sequence the callbacks use now. Run with "ja4plus-bench fmt".
+ *
+ * SPDX-License-Identifier: FoxIO License 1.1
+ */
+
+#include <stdarg.h>
+#include "../ja4plus.c"
+#include "mock.h"
+
+typedef struct {
+    const char        *name;
+    int              (*withPrintf)(char *out, int i);
+    int              (*withWriters)(char *out, int i);
+} BenchFmt_t;
+
+// Values seen in the recorded inputs
+LOCAL const uint16_t  fmtCiphers[2] = {0x1301, 0xc02f};
+LOCAL const uint16_t  fmtExtensions[2][6] = {
+    {0x002b, 0x0033},
+    {0xff01, 0x0000, 0x000b, 0x0023, 0x0010, 0x0017}
+};
+LOCAL const int       fmtExtensionsNum[2] = {2, 6};
+
+LOCAL const char     *fmtHeaderFields = "Host,User-Agent,Accept,Accept-Language,Accept-Encoding,Connection";
+LOCAL const char     *fmtCookieFields = "_ga,_gid,session,theme";
+LOCAL const char     *fmtCookieValues = "_ga=GA1.2.1234567890.1700000000,_gid=GA1.2.987654321.1700000000,session=3f2a9c,theme=dark";
+
+/******************************************************************************/
+/* What BSB_EXPORT_sprintf did */
+LOCAL int bench_fmt_bsb_sprintf(char *out, int pos, int size, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(out + pos, size - pos, fmt, args);
+    va_end(args);
+    return pos + MIN(len, size - pos - 1);
+}
+/******************************************************************************/
+LOCAL int bench_fmt_ja4s_printf(char *out, int i)
+{
+    char cipherHex[5];
+    snprintf(cipherHex, sizeof(cipherHex), "%04x", fmtCiphers[i & 1]);
+    memcpy(out, cipherHex, 4);
+
+    int len = 0;
+    for (int e = 0; e < fmtExtensionsNum[i & 1]; e++)
+        len = bench_fmt_bsb_sprintf(out + 4, len, 5 * 256, "%04x,", fmtExtensions[i & 1][e]);
+    return 4 + len - 1;
+}
+/******************************************************************************/
+LOCAL int bench_fmt_ja4s_writers(char *out, int i)
+{
+    ja4plus_fmt_hex4(out, fmtCiphers[i & 1]);
+
+    int len = 4;
+    for (int e = 0; e < fmtExtensionsNum[i & 1]; e++) {
+        len += ja4plus_fmt_hex4(out + len, fmtExtensions[i & 1][e]);
+        out[len++] = ',';
+    }
+    return len - 1;
+}
+/******************************************************************************/
+LOCAL int bench_fmt_ja4h_printf(char *out, int i)
+{
+    return snprintf(out, 32, "%s%d%d%c%c%02d%4.4s_", "ge", 1, 1, (i & 1) ? 'c' : 'n', 'n', 6, "enus");
+}
+/******************************************************************************/
+LOCAL int bench_fmt_ja4h_writers(char *out, int i)
+{
+    char *p = out;
+    memcpy(p, "ge", 2);
+    p += 2;
+    p += ja4plus_fmt_u32(p, 1);
+    p += ja4plus_fmt_u32(p, 1);
+    *(p++) = (i & 1) ? 'c' : 'n';
+    *(p++) = 'n';
+    p += ja4plus_fmt_02u(p, 6);
+    memcpy(p, "enus", 4);
+    p += 4;
+    *(p++) = '_';
+    return p - out;
+}
+/******************************************************************************/
+LOCAL int bench_fmt_ja4h_r_printf(char *out, int i)
+{
+    snprintf(out, 1024, "%s%d%d%c%c%02d%4.4s_%s_%s_%s", "ge", 1, 1, (i & 1) ? 'c' : 'n', 'n', 6, "enus",
+             fmtHeaderFields, (i & 1) ? fmtCookieFields : "", (i & 1) ? fmtCookieValues : "");
+    out[1023] = 0;
+    return strlen(out);
+}
+/******************************************************************************/
+LOCAL int bench_fmt_ja4h_r_writers(char *out, int i)
+{
+    const int size = 1023;
+    char      prefix[32];
+    int       prefixLen = bench_fmt_ja4h_writers(prefix, i);
+    int       len;
+
+    len = ja4plus_fmt_append(out, 0, size, prefix, prefixLen);
+    len = ja4plus_fmt_append(out, len, size, fmtHeaderFields, strlen(fmtHeaderFields));
+    len = ja4plus_fmt_append(out, len, size, "_", 1);
+    if (i & 1)
+        len = ja4plus_fmt_append(out, len, size, fmtCookieFields, strlen(fmtCookieFields));
+    len = ja4plus_fmt_append(out, len, size, "_", 1);
+    if (i & 1)
+        len = ja4plus_fmt_append(out, len, size, fmtCookieValues, strlen(fmtCookieValues));
+    return len;
+}
+/******************************************************************************/
+LOCAL int bench_fmt_ja4ssh_printf(char *out, int i)
+{
+    return bench_fmt_bsb_sprintf(out, 0, 50, "c%ds%d_c%ds%d_c%ds%d", 36, 36 + (i & 1) * 48, 51, 149, 60, 40);
+}
+/******************************************************************************/
+LOCAL int bench_fmt_ja4ssh_writers(char *out, int i)
+{
+    char *p = out;
+    *(p++) = 'c';
+    p += ja4plus_fmt_u32(p, 36);
+    *(p++) = 's';
+    p += ja4plus_fmt_u32(p, 36 + (i & 1) * 48);
+    memcpy(p, "_c", 2);
+    p += 2;
+    p += ja4plus_fmt_u32(p, 51);
+    *(p++) = 's';
+    p += ja4plus_fmt_u32(p, 149);
+    memcpy(p, "_c", 2);
+    p += 2;
+    p += ja4plus_fmt_u32(p, 60);
+    *(p++) = 's';
+    p += ja4plus_fmt_u32(p, 40);
+    return p - out;
+}
+/******************************************************************************/
+LOCAL int bench_fmt_ja4l_printf(char *out, int i)
+{
+    return snprintf(out, 100, "%u_%u_%u", 5000 + i % 1000, 64, 1000);
+}
+/******************************************************************************/
+LOCAL int bench_fmt_ja4l_writers(char *out, int i)
+{
+    return ja4plus_ja4l_format(out, 5000 + i % 1000, 64, 1000);
+}
+/******************************************************************************/
+LOCAL BenchFmt_t fmts[] = {
+    {"ja4s",   bench_fmt_ja4s_printf,   bench_fmt_ja4s_writers},
+    {"ja4h",   bench_fmt_ja4h_printf,   bench_fmt_ja4h_writers},
+    {"ja4h_r", bench_fmt_ja4h_r_printf, bench_fmt_ja4h_r_writers},
+    {"ja4ssh", bench_fmt_ja4ssh_printf, bench_fmt_ja4ssh_writers},
+    {"ja4l",   bench_fmt_ja4l_printf,   bench_fmt_ja4l_writers},
+};
+
+/******************************************************************************/
+LOCAL uint64_t bench_fmt_time(int (*func)(char *out, int i), int iterations, char *out)
+{
+    struct timespec start, end;
+    uint64_t        sum = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < iterations; i++) {
+        sum += func(out, i);
+        __asm__ volatile("" : : "r"(out) : "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (sum == 0)
+        printf("no output\n");
+    return (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000 + end.tv_nsec - start.tv_nsec;
+}
+/******************************************************************************/
+void bench_fmt(int iterations)
+{
+    char a[1024], b[1024];
+
+    printf("%-8s %10s %10s %10s %10s\n", "fmt", "ops", "printf ns", "writers ns", "speedup");
+    for (int f = 0; f < (int)(sizeof(fmts) / sizeof(fmts[0])); f++) {
+        // Both ways have to give the same text
+        for (int i = 0; i < 2; i++) {
+            int alen = fmts[f].withPrintf(a, i);
+            int blen = fmts[f].withWriters(b, i);
+            if (alen != blen || memcmp(a, b, alen) != 0)
+                LOGEXIT("%s formats differ: %.*s %.*s", fmts[f].name, alen, a, blen, b);
+        }
+
+        uint64_t printfNs = bench_fmt_time(fmts[f].withPrintf, iterations, a);
+        uint64_t writersNs = bench_fmt_time(fmts[f].withWriters, iterations, b);
+
+        printf("%-8s %10d %10.1f %10.1f %9.1fx\n",
+               fmts[f].name,
+               iterations,
+               (double)printfNs / iterations,
+               (double)writersNs / iterations,
+               (double)printfNs / MAX(writersNs, 1));
+    }
+}
@@ -0,0 +1,46 @@
+/* inputs.h  -- recorded inputs the bench replays
+ *
+ * SPDX-License-Identifier: FoxIO License 1.1
+ */
+
+#include <stdint.h>
+
+/* One packet of a recorded TCP session, options and times as on the wire */
+typedef struct {
+    uint8_t      direction;
+    uint8_t      flags;
+    uint8_t      ttl;
+    uint16_t     window;
+    const char  *options;           // hex
+    uint16_t     dataLen;
+    uint32_t     usec;              // since the first packet
+} BenchTCPPacket_t;
+
+typedef struct {
+    const char        *name;
+    uint8_t            v6;
+    BenchTCPPacket_t   packets[8];  // ends at the first packet with no flags
+} BenchTCPSession_t;
+
+/* Header names and values as the http parser hands them to the plugin */
+typedef struct {
+    const char  *name;
+    uint8_t      method;
+    uint8_t      major;
+    uint8_t      minor;
+    const char  *headers[32];       // name, value, ..., NULL
+} BenchHTTPRequest_t;
+
+/* Packet lengths for each direction of a recorded ssh session */
+typedef struct {
+    const char  *name;
+    uint16_t     lens[2][20];       // repeated to fill each 200 packet window
+    uint16_t     clientPackets;     // of each 200
+} BenchSSHSession_t;
+
+/* Each list ends with a NULL entry */
+extern const char                *benchServerHellos[];
+extern const char                *benchCerts[];
+extern const BenchTCPSession_t    benchTCPSessions[];
+extern const BenchHTTPRequest_t   benchHTTPRequests[];
+extern const BenchSSHSession_t    benchSSHSessions[];
@@ -0,0 +1,232 @@
+/* mock.c  -- the parts of the Arkime capture API ja4plus.c calls
+ *
+ * Fields are dropped (or printed with -v), config comes from -o key=value,
+ * and every malloc in the process is counted so the bench can report
+ * allocations per op.
+ *
+ * SPDX-License-Identifier: FoxIO License 1.1
+ */
+
+#include "mock.h"
+
+ArkimeConfig_t               config;
+uint8_t                      arkime_char_to_hexstr[256][3];
+
+uint64_t                     mockAllocs;
+uint64_t                     mockFieldAdds;
+int                          mockVerbose;
+
+ArkimePluginSaveFunc         mockPreSave;
+ArkimePluginSaveFunc         mockSave;
+ArkimePluginExitFunc         mockExit;
+ArkimePluginHttpDataFunc     mockHeaderFieldRaw;
+ArkimePluginHttpDataFunc     mockHeaderValue;
+ArkimePluginHttpFunc         mockMessageComplete;
+
+#define MOCK_MAX 32
+
+LOCAL const char            *fieldNames[MOCK_MAX];
+LOCAL int                    fieldNum = 1;
+
+LOCAL const char            *namedNames[MOCK_MAX];
+LOCAL ArkimeParserNamedFunc  namedFuncs[MOCK_MAX];
+LOCAL int                    namedNum;
+
+LOCAL char                  *configKeys[MOCK_MAX];
+LOCAL char                  *configValues[MOCK_MAX];
+LOCAL int                    configNum;
+
+/******************************************************************************/
+/*
+ * Count allocations by interposing on malloc, glib and the plugin both end
+ * up here. Frees go straight to libc.
+ */
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+    mockAllocs++;
+    return __libc_malloc(size);
+}
+/******************************************************************************/
+void *calloc(size_t nmemb, size_t size)
+{
+    mockAllocs++;
+    return __libc_calloc(nmemb, size);
+}
+/******************************************************************************/
+void *realloc(void *ptr, size_t size)
+{
+    mockAllocs++;
+    return __libc_realloc(ptr, size);
+}
+/******************************************************************************/
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    mockAllocs++;
+    return __libc_memalign(alignment, size);
+}
+#endif
+/******************************************************************************/
+int arkime_plugins_register(const char *UNUSED(name), gboolean UNUSED(storeData))
+{
+    return 0;
+}
+/******************************************************************************/
+void arkime_plugins_set_cb(const char *UNUSED(name),
+                           ArkimePluginIpFunc UNUSED(ipFunc),
+                           ArkimePluginUdpFunc UNUSED(udpFunc),
+                           ArkimePluginTcpFunc UNUSED(tcpFunc),
+                           ArkimePluginSaveFunc preSaveFunc,
+                           ArkimePluginSaveFunc saveFunc,
+                           ArkimePluginNewFunc UNUSED(newFunc),
+                           ArkimePluginExitFunc exitFunc,
+                           ArkimePluginReloadFunc UNUSED(reloadFunc))
+{
+    mockPreSave = preSaveFunc;
+    mockSave = saveFunc;
+    mockExit = exitFunc;
+}
+/******************************************************************************/
+void arkime_plugins_set_http_ext_cb(const char *UNUSED(name),
+                                    ArkimePluginHttpFunc UNUSED(onMessageBegin),
+                                    ArkimePluginHttpDataFunc UNUSED(onUrl),
+                                    ArkimePluginHttpDataFunc UNUSED(onHeaderField),
+                                    ArkimePluginHttpDataFunc onHeaderFieldRaw,
+                                    ArkimePluginHttpDataFunc onHeaderValue,
+                                    ArkimePluginHttpFunc UNUSED(onHeadersComplete),
+                                    ArkimePluginHttpDataFunc UNUSED(onBody),
+                                    ArkimePluginHttpFunc onMessageComplete)
+{
+    mockHeaderFieldRaw = onHeaderFieldRaw;
+    mockHeaderValue = onHeaderValue;
+    mockMessageComplete = onMessageComplete;
+}
+/******************************************************************************/
+void arkime_parsers_add_named_func(const char *name, ArkimeParserNamedFunc func)
+{
+    if (namedNum == MOCK_MAX) {
+        fprintf(stderr, "Too many named funcs\n");
+        exit(1);
+    }
+    namedNames[namedNum] = name;
+    namedFuncs[namedNum] = func;
+    namedNum++;
+}
+/******************************************************************************/
+ArkimeParserNamedFunc mock_named_func(const char *name)
+{
+    for (int i = 0; i < namedNum; i++) {
+        if (strcmp(namedNames[i], name) == 0)
+            return namedFuncs[i];
+    }
+    return NULL;
+}
+/******************************************************************************/
+void mock_config_set(const char *keyValue)
+{
+    const char *equal = strchr(keyValue, '=');
+    if (!equal || configNum == MOCK_MAX) {
+        fprintf(stderr, "Bad -o %s, expected key=value\n", keyValue);
+        exit(1);
+    }
+    configKeys[configNum] = g_strndup(keyValue, equal - keyValue);
+    configValues[configNum] = g_strdup(equal + 1);
+    configNum++;
+}
+/******************************************************************************/
+LOCAL const char *mock_config_get(const char *key)
+{
+    for (int i = configNum - 1; i >= 0; i--) {
+        if (strcmp(configKeys[i], key) == 0)
+            return configValues[i];
+    }
+    return NULL;
+}
+/******************************************************************************/
+gboolean arkime_config_boolean(GKeyFile *UNUSED(keyfile), const char *key, gboolean d)
+{
+    const char *value = mock_config_get(key);
+    if (!value)
+        return d;
+    return strcmp(value, "true") == 0 || strcmp(value, "1") == 0;
+}
+/******************************************************************************/
+int arkime_config_int(GKeyFile *UNUSED(keyfile), const char *key, int d, int min, int max)
+{
+    const char *value = mock_config_get(key);
+    if (!value)
+        return d;
+    return MIN(MAX(atoi(value), min), max);
+}
+/******************************************************************************/
+char *arkime_config_str(GKeyFile *UNUSED(keyfile), const char *key, const char *d)
+{
+    const char *value = mock_config_get(key);
+    if (!value)
+        value = d;
+    return g_strdup(value);
+}
+/******************************************************************************/
+int arkime_field_define(const char *UNUSED(group), const char *UNUSED(kind), const char *expression, const char *UNUSED(friendlyName), const char *UNUSED(dbField), const char *UNUSED(help), int UNUSED(type), int UNUSED(flags), ...)
+{
+    if (fieldNum == MOCK_MAX) {
+        fprintf(stderr, "Too many fields\n");
+        exit(1);
+    }
+    fieldNames[fieldNum] = expression;
+    return fieldNum++;
+}
+/******************************************************************************/
+gboolean arkime_field_string_add(int pos, ArkimeSession_t *UNUSED(session), const char *string, int len, gboolean copy)
+{
+    if (len == -1)
+        len = strlen(string);
+
+    mockFieldAdds++;
+    if (mockVerbose)
+        printf("  %s=%.*s\n", fieldNames[pos], len, string);
+
+    if (!copy)
+        g_free((char *)string);
+    return TRUE;
+}
+/******************************************************************************/
+void arkime_field_certsinfo_update_extra(void *UNUSED(cert), char *key, char *value)
+{
+    mockFieldAdds++;
+    if (mockVerbose)
+        printf("  cert.%s=%s\n", key, value);
+
+    g_free(key);
+    g_free(value);
+}
+/******************************************************************************/
+void arkime_session_add_tag(ArkimeSession_t *UNUSED(session), const char *tag)
+{
+    mockFieldAdds++;
+    if (mockVerbose)
+        printf("  tags=%s\n", tag);
+}
+/******************************************************************************/
+/* The bench is one thread, nothing can still be using it */
+void arkime_free_later(void *ptr, GDestroyNotify cb)
+{
+    cb(ptr);
+}
+/******************************************************************************/
+void mock_init()
+{
+    LOCAL const char hex[] = "0123456789abcdef";
+
+    for (int i = 0; i < 256; i++) {
+        arkime_char_to_hexstr[i][0] = hex[i >> 4];
+        arkime_char_to_hexstr[i][1] = hex[i & 0xf];
+        arkime_char_to_hexstr[i][2] = 0;
+    }
+    config.packetThreads = 1;
+}
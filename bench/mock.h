@@ -0,0 +1,24 @@
+/* mock.h  -- hooks into the mock Arkime API for the bench driver
+ *
+ * SPDX-License-Identifier: FoxIO License 1.1
+ */
+
+#include "arkime.h"
+
+extern uint64_t                  mockAllocs;
+extern uint64_t                  mockFieldAdds;
+extern int                       mockVerbose;
+
+extern ArkimePluginSaveFunc      mockPreSave;
+extern ArkimePluginSaveFunc      mockSave;
+extern ArkimePluginExitFunc      mockExit;
+extern ArkimePluginHttpDataFunc  mockHeaderFieldRaw;
+extern ArkimePluginHttpDataFunc  mockHeaderValue;
+extern ArkimePluginHttpFunc      mockMessageComplete;
+
+void                  mock_init();
+void                  mock_config_set(const char *keyValue);
+ArkimeParserNamedFunc mock_named_func(const char *name);
+
+/* fmt.c */
+void                  bench_fmt(int iterations);
@@ -10,9 +10,11 @@
  * https://github.com/FoxIO-LLC/ja4/blob/main/License%20FAQ.md
  */
 
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include "arkime.h"
 #include "../parsers/ssh_info.h"
-#include <math.h>
 
 extern ArkimeConfig_t        config;
 LOCAL int                    ja4sField;
@@ -27,12 +29,65 @@ LOCAL int                    ja4hRawField;
 
 
 LOCAL int                    ja4plus_plugin_num;
-LOCAL GChecksum             *checksums256[ARKIME_MAX_PACKET_THREADS];
+LOCAL int                    ja4plusJA4hMax;
+LOCAL gboolean               ja4plusStreamHeaders;
 extern uint8_t               arkime_char_to_hexstr[256][3];
-LOCAL gboolean               ja4Raw;
+LOCAL uint32_t               ja4plusFingerprints;
+LOCAL uint32_t               ja4plusRaw;
+LOCAL char                   ja4plus_http_methods[256][3];
+
+// Bits for ja4plusFingerprints and ja4plusRaw
+#define JA4PLUS_FP_JA4S      0x01
+#define JA4PLUS_FP_JA4X      0x02
+#define JA4PLUS_FP_JA4H      0x04
+#define JA4PLUS_FP_JA4SSH    0x08
+#define JA4PLUS_FP_JA4L      0x10   // and ja4ls
+#define JA4PLUS_FP_JA4T      0x20   // and ja4ts
+#define JA4PLUS_FP_ALL       0x3f
+#define JA4PLUS_FP_RAW       (JA4PLUS_FP_JA4S | JA4PLUS_FP_JA4X | JA4PLUS_FP_JA4H)
 
 #define JA4PLUS_SYN_ACK_COUNT 4
+
+#define JA4PLUS_TCP_START    0
+#define JA4PLUS_TCP_TRACKING 1
+#define JA4PLUS_TCP_DONE     2
+
+// Binary form of a fingerprint, the text before the hashes and the 48 bit
+// truncated sha256 values that print as the 12 hex char parts
+typedef struct {
+    uint64_t       hash[3];        // 0 prints as 000000000000
+    char           prefix[14];     // including the _ before the first hash
+    uint8_t        prefixLen;
+    uint8_t        numHash;
+} JA4PlusFP_t;
+
+// Incremental sha256 for input that arrives in pieces
 typedef struct {
+    uint32_t       state[8];
+    uint64_t       total;
+    uint8_t        buf[64];
+} JA4PlusSha256Ctx_t;
+
+// HTTP strings, only allocated once a session sees a request, pooled per thread
+typedef struct ja4plus_http_bufs {
+    struct ja4plus_http_bufs *next;  // free list
+    GString       *header_fields;  // NULL when the names are hashed as they arrive
+    JA4PlusSha256Ctx_t headerHash; // used when header_fields is NULL
+    GString       *header_value;   // accept-language value, created when seen
+    GString       *cookie_value;   // last cookie header, tokenized at complete
+    JA4PlusFP_t   *ja4h;           // distinct ja4h not added yet, added at save
+    uint16_t       ja4hNum;
+    uint16_t       ja4hSize;
+    uint16_t       ja4hDistinct;   // ja4h computed for the session
+    uint8_t        lastPending;    // last request's ja4h is still in ja4h
+    uint64_t       lastDigest[2];  // inputs of the last request
+    uint32_t       accounted;      // bytes counted in the pool for this entry
+} JA4PlusHTTPBufs_t;
+
+typedef struct ja4plus_ssh JA4PlusSSH_t;
+
+// All the per session state, one cache line allocated from a per thread slab
+typedef struct ja4plus_data {
     // Used for JA4L
     // Timestamps are reference against firstPacket
     uint32_t       timestampA;
@@ -46,128 +101,1394 @@ typedef struct {
     uint8_t        client_ttl;
     uint8_t        server_ttl;
     uint8_t        synAckTimesCnt: 3;
-} JA4PlusTCP_t;
+    uint8_t        tcpState: 2;
+    uint8_t        tcpPackets;
 
-typedef struct {
-    GString       *header_value;   // current header value
-    GString       *header_fields;
-    uint16_t       cookies;
-    uint16_t       referer;
-    uint16_t       headers;
+    // Used for JA4H
     char           state;
-    gchar         *sorted_cookie_fields;
-    gchar         *sorted_cookie_values;
     gchar          accept_lang[4];
-} JA4PlusHTTP_t;
+    uint16_t       cookies;
+    uint16_t       headers;
+    uint8_t        referer;
+
+    union {
+        JA4PlusHTTPBufs_t   *http;
+        struct ja4plus_data *next;  // free list
+    };
+    JA4PlusSSH_t  *ssh;            // only when ja4plusSSHWindow is over 200
+} __attribute__((aligned(64))) JA4PlusData_t;
+
+G_STATIC_ASSERT(sizeof(JA4PlusData_t) == 64);
+
+// Per thread allocator for session state, slabs are never returned
+#define JA4PLUS_SLAB_COUNT      1024
+#define JA4PLUS_HTTP_FREE_MAX   4096
+#define JA4PLUS_HTTP_STR_MAX    1024
+typedef struct {
+    JA4PlusData_t     *freeData;
+    JA4PlusHTTPBufs_t *freeHTTP;
+    uint32_t           freeHTTPCnt;
+    uint32_t           slabs;
+    uint64_t           bytes;      // plugin bytes in use by sessions
+} JA4PlusPool_t;
+
+LOCAL JA4PlusPool_t          pools[ARKIME_MAX_PACKET_THREADS];
+
+// Per thread event counts for each fingerprint, a cache line per thread so
+// updating them doesn't contend. Summed on the ja4plusStatsInterval timer.
+#define JA4PLUS_STAT_PRODUCED   0
+#define JA4PLUS_STAT_FAILED     1   // input couldn't be parsed
+#define JA4PLUS_STAT_TRUNCATED  2   // produced from part of the input
+#define JA4PLUS_STAT_SKIPPED    3   // not produced by choice, repeats and limits
+#define JA4PLUS_STAT_CACHE_HIT  4
+#define JA4PLUS_STAT_MATCHED    5   // found in the ja4plusMatchDB
+#define JA4PLUS_STAT_STOPPED    6   // matched a ja4plusStopSaving label
+#define JA4PLUS_STAT_RAW_SEEN   7   // raw field left out, see ja4plusRawFirstSeen
+#define JA4PLUS_STAT_NUM        8
+
+// Fingerprint index, the bit number in JA4PLUS_FP_
+#define JA4PLUS_IDX_JA4S        0
+#define JA4PLUS_IDX_JA4X        1
+#define JA4PLUS_IDX_JA4H        2
+#define JA4PLUS_IDX_JA4SSH      3
+#define JA4PLUS_IDX_JA4L        4
+#define JA4PLUS_IDX_JA4T        5
+#define JA4PLUS_IDX_NUM         6
+
+typedef struct {
+    uint64_t           counts[JA4PLUS_IDX_NUM][JA4PLUS_STAT_NUM];
+} __attribute__((aligned(64))) JA4PlusStats_t;
+
+LOCAL JA4PlusStats_t         stats[ARKIME_MAX_PACKET_THREADS];
+LOCAL int                    ja4plusStatsInterval;
+
+#define JA4PLUS_STAT(thread, fp, stat) stats[thread].counts[JA4PLUS_IDX_##fp][JA4PLUS_STAT_##stat]++
+
+// Sampled time spent in each callback, log buckets with 8 linear steps per
+// power of 2 so any value is within 12.5%. Only used when ja4plusLatencySample
+// is set, the timed callbacks are registered instead of the plain ones.
+#define JA4PLUS_HOOK_TCP        0
+#define JA4PLUS_HOOK_SERVER     1
+#define JA4PLUS_HOOK_CERT       2
+#define JA4PLUS_HOOK_HEADER     3
+#define JA4PLUS_HOOK_COMPLETE   4
+#define JA4PLUS_HOOK_SSH        5
+#define JA4PLUS_HOOK_NUM        6
+
+#define JA4PLUS_LAT_SUB_BITS    3
+#define JA4PLUS_LAT_BUCKETS     ((40 - JA4PLUS_LAT_SUB_BITS + 1) << JA4PLUS_LAT_SUB_BITS)  // up to ~18 minutes in ns
 
-#define JA4PLUS_TCP_DONE (void *)1UL
 typedef struct {
-    JA4PlusTCP_t  *tcp;
-    JA4PlusHTTP_t *http;
-} JA4PlusData_t;
+    uint32_t           tick[JA4PLUS_HOOK_NUM];
+    uint64_t           buckets[JA4PLUS_HOOK_NUM][JA4PLUS_LAT_BUCKETS];
+} __attribute__((aligned(64))) JA4PlusLatency_t;
+
+LOCAL JA4PlusLatency_t       latencies[ARKIME_MAX_PACKET_THREADS];
+LOCAL uint64_t               latencyLast[JA4PLUS_HOOK_NUM][JA4PLUS_LAT_BUCKETS];
+LOCAL uint32_t               ja4plusLatencySample;
 
+// A cookie is a view into cookie_value, prefix caches the first 8 bytes of
+// the name big endian so most compares are a single integer compare
 typedef struct {
-    char      *field;
-    char      *value;
-    uint16_t   flen;
-    uint16_t   vlen;
+    uint64_t   prefix;
+    uint32_t   field;
+    uint32_t   value;
+    uint32_t   flen;
+    uint32_t   vlen;     // 0 if no value
 } JA4PlusCookie_t;
 
+// Per thread scratch space for cookie tokenizing and sorting, grows as needed
+typedef struct {
+    JA4PlusCookie_t *cookies;
+    JA4PlusCookie_t *tmp;
+    uint32_t         size;
+    GString         *fields;
+    GString         *values;
+} JA4PlusCookieArena_t;
+
+LOCAL JA4PlusCookieArena_t   cookieArenas[ARKIME_MAX_PACKET_THREADS];
+
 #define TIMESTAMP_TO_RUSEC(ts) (ts.tv_sec - session->firstPacket.tv_sec) * 1000000 + (ts.tv_usec - session->firstPacket.tv_usec)
 
 /******************************************************************************/
-LOCAL int cookie_cmp(const void *a, const void *b)
+LOCAL JA4PlusData_t *ja4plus_data_alloc(int thread)
+{
+    JA4PlusPool_t *pool = &pools[thread];
+
+    if (!pool->freeData) {
+        JA4PlusData_t *slab = aligned_alloc(64, JA4PLUS_SLAB_COUNT * sizeof(JA4PlusData_t));
+        if (!slab)
+            LOGEXIT("ERROR - Couldn't allocate %d JA4+ session slots", JA4PLUS_SLAB_COUNT);
+        for (int i = JA4PLUS_SLAB_COUNT - 1; i >= 0; i--) {
+            slab[i].next = pool->freeData;
+            pool->freeData = &slab[i];
+        }
+        pool->slabs++;
+    }
+
+    JA4PlusData_t *data = pool->freeData;
+    pool->freeData = data->next;
+    memset(data, 0, sizeof(*data));
+    pool->bytes += sizeof(JA4PlusData_t);
+    return data;
+}
+/******************************************************************************/
+LOCAL void ja4plus_data_free(int thread, JA4PlusData_t *data)
 {
-    return strcmp(((JA4PlusCookie_t *)a)->field, ((JA4PlusCookie_t *)b)->field);
+    JA4PlusPool_t *pool = &pools[thread];
+
+    data->next = pool->freeData;
+    pool->freeData = data;
+    pool->bytes -= sizeof(JA4PlusData_t);
 }
+/******************************************************************************/
+/* Update the pool byte count with the current size of the strings */
+LOCAL void ja4plus_http_account(int thread, JA4PlusHTTPBufs_t *bufs)
+{
+    uint32_t size = sizeof(JA4PlusHTTPBufs_t) + bufs->ja4hSize * sizeof(JA4PlusFP_t);
+    if (bufs->header_fields)
+        size += bufs->header_fields->allocated_len;
+    if (bufs->header_value)
+        size += bufs->header_value->allocated_len;
+    if (bufs->cookie_value)
+        size += bufs->cookie_value->allocated_len;
+
+    pools[thread].bytes += size - bufs->accounted;
+    bufs->accounted = size;
+}
+/******************************************************************************/
+LOCAL JA4PlusHTTPBufs_t *ja4plus_http_alloc(int thread)
+{
+    JA4PlusPool_t     *pool = &pools[thread];
+    JA4PlusHTTPBufs_t *bufs = pool->freeHTTP;
 
+    if (bufs) {
+        pool->freeHTTP = bufs->next;
+        pool->freeHTTPCnt--;
+    } else {
+        bufs = ARKIME_TYPE_ALLOC0(JA4PlusHTTPBufs_t);
+        if (!ja4plusStreamHeaders)
+            bufs->header_fields = g_string_sized_new(100);
+    }
+    ja4plus_http_account(thread, bufs);
+    return bufs;
+}
 /******************************************************************************/
-/* Actually process the cookie/accept-language header that has been saved up. */
-LOCAL void ja4plus_http_process_headers (ArkimeSession_t *session)
+/* Keep the strings for the next session unless they grew large */
+LOCAL void ja4plus_http_release_str(GString **str)
 {
-    JA4PlusData_t *ja4plus_data = (JA4PlusData_t *) session->pluginData[ja4plus_plugin_num];
-    JA4PlusHTTP_t *ja4_http = ja4plus_data->http;
-
-    if (ja4_http->state == 'c') {
-        int num = 0;
-        JA4PlusCookie_t cookies[100];
-        const char *start = ja4_http->header_value->str;
-        const char *end = start + ja4_http->header_value->len;
-
-        int totalFlen = 0;
-        int totalVlen = 0;
-        while (start < end) {
-            while (start < end && isspace(*start)) start++;
-            char *equal = memchr(start, '=', end - start);
-            if (!equal)
-                break;
-            int flen = equal - start;
-            cookies[num].field = g_strndup(start, flen); // COPY
-            cookies[num].flen = flen;
-            totalFlen += flen;
-
-            start = memchr(equal + 1, ';', end - (equal + 1));
-            equal++;
-            while (equal < end && isspace(*equal)) equal++;
-            if (equal < end && equal != start) {
-                int vlen = start ? start - equal : end - equal;
-                cookies[num].vlen = vlen;
-                totalVlen += vlen;
-
-                cookies[num].value = equal; // NO COPY
+    if (!*str)
+        return;
+
+    if ((*str)->allocated_len > JA4PLUS_HTTP_STR_MAX) {
+        g_string_free(*str, TRUE);
+        *str = NULL;
+    } else {
+        g_string_truncate(*str, 0);
+    }
+}
+/******************************************************************************/
+LOCAL void ja4plus_http_free(int thread, JA4PlusHTTPBufs_t *bufs)
+{
+    JA4PlusPool_t *pool = &pools[thread];
+
+    pool->bytes -= bufs->accounted;
+    bufs->accounted = 0;
+
+    if (pool->freeHTTPCnt >= JA4PLUS_HTTP_FREE_MAX) {
+        if (bufs->header_fields)
+            g_string_free(bufs->header_fields, TRUE);
+        if (bufs->header_value)
+            g_string_free(bufs->header_value, TRUE);
+        if (bufs->cookie_value)
+            g_string_free(bufs->cookie_value, TRUE);
+        g_free(bufs->ja4h);
+        ARKIME_TYPE_FREE(JA4PlusHTTPBufs_t, bufs);
+        return;
+    }
+
+    if (!ja4plusStreamHeaders) {
+        ja4plus_http_release_str(&bufs->header_fields);
+        if (!bufs->header_fields)
+            bufs->header_fields = g_string_sized_new(100);
+    }
+    ja4plus_http_release_str(&bufs->header_value);
+    ja4plus_http_release_str(&bufs->cookie_value);
+    bufs->ja4hNum = 0;
+    bufs->ja4hDistinct = 0;
+    bufs->lastPending = 0;
+
+    bufs->next = pool->freeHTTP;
+    pool->freeHTTP = bufs;
+    pool->freeHTTPCnt++;
+}
+/******************************************************************************/
+/* Formatting
+ *
+ * Table driven writers used to build the fingerprints instead of the printf
+ * family. They write to out without a NUL and return the number of chars.
+ */
+LOCAL const char ja4plus_digits100[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/******************************************************************************/
+/* %04x */
+LOCAL inline int ja4plus_fmt_hex4(char *out, uint16_t v)
+{
+    memcpy(out, arkime_char_to_hexstr[v >> 8], 2);
+    memcpy(out + 2, arkime_char_to_hexstr[v & 0xff], 2);
+    return 4;
+}
+/******************************************************************************/
+/* %u */
+LOCAL int ja4plus_fmt_u32(char *out, uint32_t v)
+{
+    char  tmp[10];
+    char *p = tmp + sizeof(tmp);
+
+    while (v >= 100) {
+        p -= 2;
+        memcpy(p, ja4plus_digits100 + (v % 100) * 2, 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, ja4plus_digits100 + v * 2, 2);
+    } else {
+        *(--p) = '0' + v;
+    }
+
+    int len = tmp + sizeof(tmp) - p;
+    memcpy(out, p, len);
+    return len;
+}
+/******************************************************************************/
+/* %02u */
+LOCAL inline int ja4plus_fmt_02u(char *out, uint32_t v)
+{
+    if (v < 100) {
+        memcpy(out, ja4plus_digits100 + v * 2, 2);
+        return 2;
+    }
+    return ja4plus_fmt_u32(out, v);
+}
+/******************************************************************************/
+/* Append as much of str as fits before size, returns the new position */
+LOCAL inline int ja4plus_fmt_append(char *out, int pos, int size, const char *str, int len)
+{
+    len = MIN(len, size - pos);
+    memcpy(out + pos, str, len);
+    return pos + len;
+}
+/******************************************************************************/
+/* Text of a binary fingerprint, at most 13 + 3 * 13 chars */
+LOCAL int ja4plus_fp_format(const JA4PlusFP_t *fp, char *out)
+{
+    char *p = out;
+
+    memcpy(p, fp->prefix, fp->prefixLen);
+    p += fp->prefixLen;
+    for (int i = 0; i < fp->numHash; i++) {
+        if (i > 0)
+            *(p++) = '_';
+        for (int shift = 40; shift >= 0; shift -= 8) {
+            memcpy(p, arkime_char_to_hexstr[(fp->hash[i] >> shift) & 0xff], 2);
+            p += 2;
+        }
+    }
+    return p - out;
+}
+/******************************************************************************/
+LOCAL inline gboolean ja4plus_fp_equal(const JA4PlusFP_t *a, const JA4PlusFP_t *b)
+{
+    return a->hash[0] == b->hash[0] && a->hash[1] == b->hash[1] && a->hash[2] == b->hash[2] &&
+           a->prefixLen == b->prefixLen && a->numHash == b->numHash &&
+           memcmp(a->prefix, b->prefix, a->prefixLen) == 0;
+}
+
+/******************************************************************************/
+/* Truncated SHA256
+ *
+ * Every ja4+ hash is the first 12 hex characters of a SHA256, so we only ever
+ * format the first 6 bytes of the digest. The block function is picked at init,
+ * using the SHA extensions when the cpu has them.
+ */
+LOCAL const uint32_t ja4plus_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+LOCAL const uint32_t ja4plus_sha256_h0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+typedef void (*JA4PlusSha256BlocksFunc)(uint32_t state[8], const uint8_t *data, size_t blocks);
+
+#define JA4PLUS_ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define JA4PLUS_LOAD_BE32(p) ((uint32_t)(p)[0] << 24 | (uint32_t)(p)[1] << 16 | (uint32_t)(p)[2] << 8 | (uint32_t)(p)[3])
+
+/******************************************************************************/
+LOCAL void ja4plus_sha256_blocks_c(uint32_t state[8], const uint8_t *data, size_t blocks)
+{
+    uint32_t w[64];
+
+    while (blocks--) {
+        for (int i = 0; i < 16; i++) {
+            w[i] = JA4PLUS_LOAD_BE32(data + i * 4);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = JA4PLUS_ROR32(w[i - 15], 7) ^ JA4PLUS_ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = JA4PLUS_ROR32(w[i - 2], 17) ^ JA4PLUS_ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int i = 0; i < 64; i++) {
+            uint32_t S1 = JA4PLUS_ROR32(e, 6) ^ JA4PLUS_ROR32(e, 11) ^ JA4PLUS_ROR32(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + S1 + ch + ja4plus_sha256_k[i] + w[i];
+            uint32_t S0 = JA4PLUS_ROR32(a, 2) ^ JA4PLUS_ROR32(a, 13) ^ JA4PLUS_ROR32(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = S0 + maj;
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+
+        data += 64;
+    }
+}
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+/******************************************************************************/
+__attribute__((target("sha,sse4.1")))
+LOCAL void ja4plus_sha256_blocks_shani(uint32_t state[8], const uint8_t *data, size_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_loadu_si128((const __m128i *)&state[0]);
+    __m128i state1 = _mm_loadu_si128((const __m128i *)&state[4]);
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);              // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);        // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);     // CDGH
+
+    while (blocks--) {
+        const __m128i abef = state0;
+        const __m128i cdgh = state1;
+        __m128i w[4];
+
+        for (int i = 0; i < 16; i++) {
+            if (i < 4) {
+                w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * 16)), mask);
             } else {
-                cookies[num].value = 0;
-                cookies[num].vlen = 0;
+                __m128i m = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+                m = _mm_add_epi32(m, _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+                w[i & 3] = _mm_sha256msg2_epu32(m, w[(i + 3) & 3]);
             }
-            num++;
-            if (num == 99)
-                break;
 
-            if (!start)
-                break;
-            start++;
+            __m128i msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i *)&ja4plus_sha256_k[i * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
         }
 
-        ja4_http->cookies = num;
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+        data += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);           // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);        // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);     // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);        // ABEF
+
+    _mm_storeu_si128((__m128i *)&state[0], state0);
+    _mm_storeu_si128((__m128i *)&state[4], state1);
+}
+#endif
+
+LOCAL JA4PlusSha256BlocksFunc ja4plus_sha256_blocks = ja4plus_sha256_blocks_c;
+
+/******************************************************************************/
+/* Pad the total % 64 bytes at rest for a message of total bytes into last,
+ * returns the number of 64 byte blocks written.
+ */
+LOCAL int ja4plus_sha256_pad(const uint8_t *rest, uint64_t total, uint8_t last[128])
+{
+    size_t rem = total % 64;
+    size_t lastLen = (rem < 56) ? 64 : 128;
+    memcpy(last, rest, rem);
+    last[rem] = 0x80;
+    memset(last + rem + 1, 0, lastLen - rem - 9);
+
+    uint64_t bits = total * 8;
+    for (int i = 0; i < 8; i++) {
+        last[lastLen - 1 - i] = bits >> (i * 8);
+    }
+    return lastLen / 64;
+}
+/******************************************************************************/
+LOCAL inline int ja4plus_sha256_tail(const uint8_t *data, size_t len, uint8_t last[128])
+{
+    return ja4plus_sha256_pad(data + len - len % 64, len, last);
+}
+/******************************************************************************/
+LOCAL void ja4plus_sha256(const void *data, size_t len, uint32_t state[8])
+{
+    const uint8_t *p = data;
+    uint8_t        last[128];
+
+    memcpy(state, ja4plus_sha256_h0, sizeof(ja4plus_sha256_h0));
 
-        if (num != 0) {
+    if (len >= 64) {
+        ja4plus_sha256_blocks(state, p, len / 64);
+    }
 
-            qsort(cookies, num, sizeof(JA4PlusCookie_t), cookie_cmp);
+    int lastBlocks = ja4plus_sha256_tail(p, len, last);
+    ja4plus_sha256_blocks(state, last, lastBlocks);
+}
+/******************************************************************************/
+LOCAL void ja4plus_sha256_init(JA4PlusSha256Ctx_t *ctx)
+{
+    memcpy(ctx->state, ja4plus_sha256_h0, sizeof(ja4plus_sha256_h0));
+    ctx->total = 0;
+}
+/******************************************************************************/
+LOCAL void ja4plus_sha256_update(JA4PlusSha256Ctx_t *ctx, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    size_t         used = ctx->total % 64;
 
-            g_free(ja4_http->sorted_cookie_fields);
-            ja4_http->sorted_cookie_fields = g_malloc(totalFlen + num);
+    ctx->total += len;
 
-            g_free(ja4_http->sorted_cookie_values);
-            ja4_http->sorted_cookie_values = g_malloc(totalFlen + num + totalVlen + num);
+    // Finish a partial block first
+    if (used) {
+        size_t n = MIN(len, 64 - used);
+        memcpy(ctx->buf + used, p, n);
+        if (used + n < 64)
+            return;
+        ja4plus_sha256_blocks(ctx->state, ctx->buf, 1);
+        p += n;
+        len -= n;
+    }
 
-            char *fpos = ja4_http->sorted_cookie_fields;
-            char *fvpos = ja4_http->sorted_cookie_values;
-            for (int i = 0; i < num; i++) {
-                memcpy(fpos, cookies[i].field, cookies[i].flen);
-                fpos += cookies[i].flen;
-                *(fpos++) = ',';
+    if (len >= 64) {
+        ja4plus_sha256_blocks(ctx->state, p, len / 64);
+        p += len & ~(size_t)63;
+        len &= 63;
+    }
+    memcpy(ctx->buf, p, len);
+}
+/******************************************************************************/
+/* Digest of everything so far, ctx can keep being updated */
+LOCAL void ja4plus_sha256_final(const JA4PlusSha256Ctx_t *ctx, uint32_t state[8])
+{
+    uint8_t last[128];
 
-                memcpy(fvpos, cookies[i].field, cookies[i].flen);
-                fvpos += cookies[i].flen;
+    memcpy(state, ctx->state, sizeof(ctx->state));
+    int lastBlocks = ja4plus_sha256_pad(ctx->buf, ctx->total, last);
+    ja4plus_sha256_blocks(state, last, lastBlocks);
+}
+/******************************************************************************/
+/* Format the first 6 bytes of the digest as 12 hex characters */
+LOCAL inline void ja4plus_hash12_format(const uint32_t state[8], char out[12])
+{
+    memcpy(out + 0, arkime_char_to_hexstr[state[0] >> 24], 2);
+    memcpy(out + 2, arkime_char_to_hexstr[(state[0] >> 16) & 0xff], 2);
+    memcpy(out + 4, arkime_char_to_hexstr[(state[0] >> 8) & 0xff], 2);
+    memcpy(out + 6, arkime_char_to_hexstr[state[0] & 0xff], 2);
+    memcpy(out + 8, arkime_char_to_hexstr[state[1] >> 24], 2);
+    memcpy(out + 10, arkime_char_to_hexstr[(state[1] >> 16) & 0xff], 2);
+}
+/******************************************************************************/
+/* The 12 character truncated SHA256 used by all the ja4+ fingerprints, out is
+ * not NUL terminated.
+ */
+LOCAL void ja4plus_hash12(const void *data, size_t len, char out[12])
+{
+    uint32_t state[8];
 
-                if (cookies[i].value) {
-                    *(fvpos++) = '=';
-                    memcpy(fvpos, cookies[i].value, cookies[i].vlen);
-                    fvpos += cookies[i].vlen;
-                }
-                *(fvpos++) = ',';
+    ja4plus_sha256(data, len, state);
+    ja4plus_hash12_format(state, out);
+}
+/******************************************************************************/
+/* Several independent messages hashed together, out is where the 12 hex
+ * characters go, or if out is NULL bin gets the 48 bit value.
+ */
+typedef struct {
+    const void    *data;
+    size_t         len;
+    char          *out;
+    uint64_t      *bin;
+} JA4PlusHashJob_t;
+
+/******************************************************************************/
+/* The first 6 bytes of the digest as a number */
+LOCAL inline uint64_t ja4plus_hash48(const uint32_t state[8])
+{
+    return (uint64_t)state[0] << 16 | state[1] >> 16;
+}
+/******************************************************************************/
+LOCAL inline void ja4plus_hash_job_done(JA4PlusHashJob_t *job, const uint32_t state[8])
+{
+    if (job->out)
+        ja4plus_hash12_format(state, job->out);
+    else
+        *job->bin = ja4plus_hash48(state);
+}
+
+typedef void (*JA4PlusSha256MultiFunc)(JA4PlusHashJob_t *jobs, int num);
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JA4PLUS_MM256_ROR32(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+/******************************************************************************/
+/* Multi buffer SHA256, each of the 8 AVX2 lanes hashes a different job. Lanes
+ * that run out of blocks keep their state through a blend.
+ */
+__attribute__((target("avx2")))
+LOCAL void ja4plus_sha256_x8_avx2(JA4PlusHashJob_t *jobs, int num)
+{
+    uint8_t        last[8][128];
+    const uint8_t *data[8];
+    size_t         fullBlocks[8];
+    size_t         totalBlocks[8];
+    size_t         maxBlocks = 0;
+
+    for (int l = 0; l < 8; l++) {
+        if (l < num) {
+            data[l] = jobs[l].data;
+            fullBlocks[l] = jobs[l].len / 64;
+            totalBlocks[l] = fullBlocks[l] + ja4plus_sha256_tail(data[l], jobs[l].len, last[l]);
+        } else {
+            data[l] = last[0];
+            fullBlocks[l] = totalBlocks[l] = 0;
+        }
+        maxBlocks = MAX(maxBlocks, totalBlocks[l]);
+    }
+
+    __m256i state[8];
+    for (int i = 0; i < 8; i++) {
+        state[i] = _mm256_set1_epi32(ja4plus_sha256_h0[i]);
+    }
+
+    for (size_t b = 0; b < maxBlocks; b++) {
+        uint32_t words[16][8] __attribute__((aligned(32)));
+        uint32_t active[8] __attribute__((aligned(32)));
+
+        for (int l = 0; l < 8; l++) {
+            const uint8_t *block;
+            if (b < fullBlocks[l])
+                block = data[l] + b * 64;
+            else if (b < totalBlocks[l])
+                block = last[l] + (b - fullBlocks[l]) * 64;
+            else
+                block = last[0];
+
+            active[l] = (b < totalBlocks[l]) ? 0xffffffff : 0;
+            for (int i = 0; i < 16; i++) {
+                words[i][l] = JA4PLUS_LOAD_BE32(block + i * 4);
+            }
+        }
+
+        __m256i w[16];
+        for (int i = 0; i < 16; i++) {
+            w[i] = _mm256_load_si256((const __m256i *)words[i]);
+        }
+
+        __m256i a = state[0], b1 = state[1], c = state[2], d = state[3];
+        __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int i = 0; i < 64; i++) {
+            if (i >= 16) {
+                __m256i w15 = w[(i - 15) & 15];
+                __m256i w2 = w[(i - 2) & 15];
+                __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(JA4PLUS_MM256_ROR32(w15, 7), JA4PLUS_MM256_ROR32(w15, 18)), _mm256_srli_epi32(w15, 3));
+                __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(JA4PLUS_MM256_ROR32(w2, 17), JA4PLUS_MM256_ROR32(w2, 19)), _mm256_srli_epi32(w2, 10));
+                w[i & 15] = _mm256_add_epi32(_mm256_add_epi32(w[i & 15], s0), _mm256_add_epi32(w[(i - 7) & 15], s1));
             }
-            *(fpos - 1) = 0;
-            *(fvpos - 1) = 0;
 
-            for (int i = 0; i < num; i++) {
-                g_free(cookies[i].field);
+            __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(JA4PLUS_MM256_ROR32(e, 6), JA4PLUS_MM256_ROR32(e, 11)), JA4PLUS_MM256_ROR32(e, 25));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, S1), _mm256_add_epi32(ch, _mm256_add_epi32(_mm256_set1_epi32(ja4plus_sha256_k[i]), w[i & 15])));
+            __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(JA4PLUS_MM256_ROR32(a, 2), JA4PLUS_MM256_ROR32(a, 13)), JA4PLUS_MM256_ROR32(a, 22));
+            __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b1), _mm256_and_si256(c, _mm256_or_si256(a, b1)));
+            __m256i t2 = _mm256_add_epi32(S0, maj);
+
+            h = g;
+            g = f;
+            f = e;
+            e = _mm256_add_epi32(d, t1);
+            d = c;
+            c = b1;
+            b1 = a;
+            a = _mm256_add_epi32(t1, t2);
+        }
+
+        const __m256i mask = _mm256_load_si256((const __m256i *)active);
+        const __m256i out[8] = {a, b1, c, d, e, f, g, h};
+        for (int i = 0; i < 8; i++) {
+            state[i] = _mm256_blendv_epi8(state[i], _mm256_add_epi32(state[i], out[i]), mask);
+        }
+    }
+
+    // Only the first 6 bytes of each digest are used
+    uint32_t state0[8] __attribute__((aligned(32)));
+    uint32_t state1[8] __attribute__((aligned(32)));
+    _mm256_store_si256((__m256i *)state0, state[0]);
+    _mm256_store_si256((__m256i *)state1, state[1]);
+    for (int l = 0; l < num; l++) {
+        const uint32_t digest[8] = {state0[l], state1[l]};
+        ja4plus_hash_job_done(&jobs[l], digest);
+    }
+}
+#endif
+
+LOCAL JA4PlusSha256MultiFunc ja4plus_sha256_multi;
+LOCAL int                    ja4plusMultiMin = 2;
+
+/******************************************************************************/
+/* Hash several jobs, using the multi buffer engine when there are enough of
+ * them to be worth it.
+ */
+LOCAL void ja4plus_hash12_many(JA4PlusHashJob_t *jobs, int num)
+{
+    if (ja4plus_sha256_multi && num >= ja4plusMultiMin) {
+        for (int i = 0; i < num; i += 8) {
+            ja4plus_sha256_multi(jobs + i, MIN(8, num - i));
+        }
+        return;
+    }
+
+    uint32_t state[8];
+    for (int i = 0; i < num; i++) {
+        ja4plus_sha256(jobs[i].data, jobs[i].len, state);
+        ja4plus_hash_job_done(&jobs[i], state);
+    }
+}
+/******************************************************************************/
+LOCAL void ja4plus_hash12_init()
+{
+    const char *engine = "portable";
+
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA)) {
+        ja4plus_sha256_blocks = ja4plus_sha256_blocks_shani;
+        engine = "sha-ni";
+    }
+
+    // With the SHA extensions a single hash is already fast, so only go
+    // multi buffer once more than half the lanes would be used
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        ja4plus_sha256_multi = ja4plus_sha256_x8_avx2;
+        ja4plusMultiMin = (ja4plus_sha256_blocks == ja4plus_sha256_blocks_c) ? 2 : 5;
+    }
+#endif
+
+    // Make sure the engines picked agree with the known answer for "abc"
+    char out[2][12];
+    JA4PlusHashJob_t jobs[2] = {{"abc", 3, out[0], NULL}, {"abc", 3, out[1], NULL}};
+    ja4plus_hash12("abc", 3, out[0]);
+    if (memcmp(out[0], "ba7816bf8f01", 12) != 0) {
+        ja4plus_sha256_blocks = ja4plus_sha256_blocks_c;
+        engine = "portable";
+    }
+
+    if (ja4plus_sha256_multi) {
+        ja4plus_sha256_multi(jobs, 2);
+        if (memcmp(out[0], "ba7816bf8f01", 12) != 0 || memcmp(out[1], "ba7816bf8f01", 12) != 0) {
+            ja4plus_sha256_multi = NULL;
+        }
+    }
+
+    if (config.debug)
+        LOG("JA4+ using %s sha256%s", engine, ja4plus_sha256_multi ? " with avx2 multi buffer" : "");
+}
+/******************************************************************************/
+/* Per thread queue of JA4s fingerprints waiting on their hash, flushed when
+ * full and before any session on the thread is saved.
+ */
+typedef struct {
+    ArkimeSession_t *session;
+    uint64_t         digest[2];     // cache key, keyLen 0 if not caching
+    uint16_t         keyLen;
+    uint16_t         len;
+    char             ja4s[26];
+    char             buf[5 * 256];
+} JA4PlusPendingJA4S_t;
+
+typedef struct {
+    JA4PlusPendingJA4S_t *pending;
+    int                   num;
+} JA4PlusHashBatch_t;
+
+LOCAL JA4PlusHashBatch_t     hashBatches[ARKIME_MAX_PACKET_THREADS];
+LOCAL int                    ja4plusHashBatch;
+
+/******************************************************************************/
+/* Fingerprint result caches
+ *
+ * The same certificates and server hellos are seen over and over, so each
+ * thread keeps 4 way set associative caches from a seeded 128 bit digest of
+ * the inputs to the finished fingerprint strings. Each set is replaced in
+ * CLOCK order using the ref bits.
+ */
+#define JA4PLUS_CACHE_WAYS 4
+typedef struct {
+    uint64_t       digest[2];
+    uint32_t       len;             // length of the key, 0 if the entry is empty
+    uint8_t        ref;
+    uint8_t        fpLen;
+    char           fp[52];
+    char          *raw;             // NULL unless raw is enabled
+    int            rawLen;
+} JA4PlusCacheEntry_t;
+
+typedef struct {
+    JA4PlusCacheEntry_t      *entries;
+    uint8_t                  *hands;
+    uint32_t                  setMask;
+    uint64_t                  hits;
+    uint64_t                  misses;
+    uint64_t                  evictions;
+} JA4PlusCache_t;
+
+LOCAL JA4PlusCache_t         certCaches[ARKIME_MAX_PACKET_THREADS];
+LOCAL JA4PlusCache_t         ja4sCaches[ARKIME_MAX_PACKET_THREADS];
+LOCAL int                    ja4plusCertCacheSize;
+LOCAL int                    ja4plusJA4sCacheSize;
+LOCAL uint64_t               ja4plusDigestSeed;
+
+/******************************************************************************/
+LOCAL inline uint64_t ja4plus_mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+/******************************************************************************/
+/* Cheap, non cryptographic, 128 bit digest. Seeded at startup so it can't be
+ * targeted for collisions from the wire.
+ */
+LOCAL void ja4plus_digest128(const uint8_t *data, size_t len, uint64_t digest[2])
+{
+    uint64_t h1 = ja4plusDigestSeed ^ len;
+    uint64_t h2 = ~ja4plusDigestSeed + len;
+    uint64_t w;
+
+    for (; len >= 8; data += 8, len -= 8) {
+        memcpy(&w, data, 8);
+        h1 = (h1 ^ (w * 0x87c37b91114253d5ULL)) * 0x9e3779b97f4a7c15ULL;
+        h1 = (h1 << 31) | (h1 >> 33);
+        h2 = (h2 + (w * 0x4cf5ad432745937fULL)) ^ (h2 >> 29);
+        h2 = ((h2 << 27) | (h2 >> 37)) * 0xc2b2ae3d27d4eb4fULL;
+    }
+
+    w = 0;
+    memcpy(&w, data, len);
+    h1 ^= w * 0x87c37b91114253d5ULL;
+    h2 += w * 0x4cf5ad432745937fULL;
+
+    digest[0] = ja4plus_mix64(h1 + h2);
+    digest[1] = ja4plus_mix64(h2 ^ (h1 >> 7));
+}
+/******************************************************************************/
+LOCAL void ja4plus_cache_init(JA4PlusCache_t *cache, int size)
+{
+    // Number of sets is a power of 2 so the set is just a mask of the digest
+    uint32_t sets = 1;
+    while (sets * JA4PLUS_CACHE_WAYS < (uint32_t)size)
+        sets <<= 1;
+
+    cache->entries = g_malloc0(sets * JA4PLUS_CACHE_WAYS * sizeof(JA4PlusCacheEntry_t));
+    cache->hands = g_malloc0(sets);
+    cache->setMask = sets - 1;
+}
+/******************************************************************************/
+LOCAL JA4PlusCacheEntry_t *ja4plus_cache_lookup(JA4PlusCache_t *cache, const uint64_t digest[2], uint32_t len)
+{
+    JA4PlusCacheEntry_t *set = cache->entries + (digest[0] & cache->setMask) * JA4PLUS_CACHE_WAYS;
+
+    for (int i = 0; i < JA4PLUS_CACHE_WAYS; i++) {
+        if (set[i].len == len && set[i].digest[0] == digest[0] && set[i].digest[1] == digest[1]) {
+            set[i].ref = 1;
+            cache->hits++;
+            return &set[i];
+        }
+    }
+    cache->misses++;
+    return NULL;
+}
+/******************************************************************************/
+LOCAL void ja4plus_cache_add(JA4PlusCache_t *cache, const uint64_t digest[2], uint32_t len, const char *fp, int fpLen, const char *raw, int rawLen)
+{
+    uint32_t setNum = digest[0] & cache->setMask;
+    JA4PlusCacheEntry_t *set = cache->entries + setNum * JA4PLUS_CACHE_WAYS;
+    uint8_t *hand = &cache->hands[setNum];
+
+    // Clear ref bits until we find an entry that hasn't been used recently
+    while (set[*hand].len != 0 && set[*hand].ref) {
+        set[*hand].ref = 0;
+        *hand = (*hand + 1) % JA4PLUS_CACHE_WAYS;
+    }
+
+    JA4PlusCacheEntry_t *entry = &set[*hand];
+    *hand = (*hand + 1) % JA4PLUS_CACHE_WAYS;
+
+    if (entry->len != 0) {
+        cache->evictions++;
+        g_free(entry->raw);
+    }
+
+    entry->digest[0] = digest[0];
+    entry->digest[1] = digest[1];
+    entry->len = len;
+    entry->ref = 0;
+    entry->fpLen = fpLen;
+    memcpy(entry->fp, fp, fpLen);
+    entry->fp[fpLen] = 0;
+
+    // Each thread keeps its own copy, sharing them across threads would save
+    // little since arkime_field_string_add copies it into every session anyway
+    if (raw) {
+        entry->raw = g_malloc(rawLen + 1);
+        memcpy(entry->raw, raw, rawLen);
+        entry->raw[rawLen] = 0;
+        entry->rawLen = rawLen;
+    } else {
+        entry->raw = NULL;
+        entry->rawLen = 0;
+    }
+}
+/******************************************************************************/
+LOCAL void ja4plus_cache_log(const char *name, JA4PlusCache_t *caches)
+{
+    uint64_t hits = 0, misses = 0, evictions = 0;
+    for (int t = 0; t < config.packetThreads; t++) {
+        hits += caches[t].hits;
+        misses += caches[t].misses;
+        evictions += caches[t].evictions;
+    }
+    LOG("%s cache hits: %" PRIu64 " misses: %" PRIu64 " evictions: %" PRIu64, name, hits, misses, evictions);
+}
+/******************************************************************************/
+/* Known fingerprint database
+ *
+ * ja4plusMatchDB is a file built by tools/ja4plus-db.pl from a CSV of
+ * type,fingerprint,label. It is mapped read only and an open addressing index
+ * of the entries, keyed on the digest of the type and fingerprint, is built at
+ * load so a lookup is one probe in the usual case. A fingerprint that is found
+ * adds its label to the session tags.
+ *
+ * The file is checked every ja4plusMatchReload seconds and a changed one is
+ * mapped and swapped in with an atomic pointer store. The packet threads never
+ * lock, the old map is released with arkime_free_later so a callback still
+ * using it has its own grace period, whatever the reload interval.
+ *
+ * Labels listed in ja4plusStopSaving are a policy, a session that matches one
+ * stops having its packets written ja4plusStopSavingAfter packets later but is
+ * still saved with all its fields. Which entries have those labels is worked
+ * out at load and kept in the index slot, so the policy costs nothing more
+ * than the lookup.
+ */
+#define JA4PLUS_MATCH_MAGIC     "JA4PDB1"
+#define JA4PLUS_MATCH_ORDER     0x01020304
+
+#define JA4PLUS_MATCH_JA4S      1
+#define JA4PLUS_MATCH_JA4X      2
+#define JA4PLUS_MATCH_JA4H      3
+#define JA4PLUS_MATCH_JA4T      4
+#define JA4PLUS_MATCH_JA4TS     5
+#define JA4PLUS_MATCH_TYPES     6
+
+typedef struct {
+    char           magic[8];
+    uint32_t       order;          // JA4PLUS_MATCH_ORDER in the file's byte order
+    uint32_t       count;
+    uint32_t       entriesOffset;
+    uint32_t       stringsOffset;
+    uint32_t       stringsLen;
+    uint32_t       pad;
+} JA4PlusMatchHeader_t;
+
+typedef struct {
+    uint32_t       fpOffset;       // into the strings
+    uint32_t       labelOffset;    // NUL terminated
+    uint16_t       fpLen;
+    uint16_t       labelLen;
+    uint8_t        type;
+    uint8_t        pad[3];
+} JA4PlusMatchEntry_t;
+
+G_STATIC_ASSERT(sizeof(JA4PlusMatchHeader_t) == 32);
+G_STATIC_ASSERT(sizeof(JA4PlusMatchEntry_t) == 16);
+
+// Index slot, entry is the entry number + 1 so 0 is empty
+typedef struct {
+    uint32_t       check;          // more digest bits, to skip most compares
+    uint32_t       entry: 31;
+    uint32_t       stopSaving: 1;
+} JA4PlusMatchSlot_t;
+
+typedef struct {
+    GMappedFile               *map;
+    const JA4PlusMatchEntry_t *entries;
+    const char                *strings;
+    JA4PlusMatchSlot_t        *slots;
+    uint32_t                   mask;       // slots - 1, at least twice the entries
+    struct stat                st;
+} JA4PlusMatchDB_t;
+
+LOCAL JA4PlusMatchDB_t      *matchDB;
+LOCAL char                  *ja4plusMatchFile;
+LOCAL int                    ja4plusMatchReload;
+LOCAL GHashTable            *stopSavingLabels;
+LOCAL int                    ja4plusStopSavingAfter;
+
+/******************************************************************************/
+LOCAL void ja4plus_match_free(JA4PlusMatchDB_t *db)
+{
+    g_mapped_file_unref(db->map);
+    g_free(db->slots);
+    g_free(db);
+}
+/******************************************************************************/
+LOCAL inline void ja4plus_match_key(int type, const char *fp, int len, uint64_t *pos, uint32_t *check)
+{
+    uint64_t digest[2];
+    ja4plus_digest128((const uint8_t *)fp, len, digest);
+    *pos = digest[0] + type * 0x9e3779b97f4a7c15ULL;
+    *check = (uint32_t)digest[1];
+}
+/******************************************************************************/
+/* Map and check the file, NULL and a warning if it isn't usable */
+LOCAL JA4PlusMatchDB_t *ja4plus_match_load(const char *file)
+{
+    JA4PlusMatchDB_t *db = g_new0(JA4PlusMatchDB_t, 1);
+    GError           *error = NULL;
+
+    if (stat(file, &db->st) != 0) {
+        LOG("WARNING - Can't stat ja4plusMatchDB %s: %s", file, strerror(errno));
+        g_free(db);
+        return NULL;
+    }
+
+    db->map = g_mapped_file_new(file, FALSE, &error);
+    if (!db->map) {
+        LOG("WARNING - Can't map ja4plusMatchDB %s: %s", file, error->message);
+        g_error_free(error);
+        g_free(db);
+        return NULL;
+    }
+
+    const char *data = g_mapped_file_get_contents(db->map);
+    gsize       size = g_mapped_file_get_length(db->map);
+    const JA4PlusMatchHeader_t *hdr = (const JA4PlusMatchHeader_t *)data;
+
+    if (size < sizeof(*hdr) || memcmp(hdr->magic, JA4PLUS_MATCH_MAGIC, 8) != 0 || hdr->order != JA4PLUS_MATCH_ORDER ||
+        hdr->entriesOffset % 8 || hdr->entriesOffset > size || hdr->count > (size - hdr->entriesOffset) / sizeof(JA4PlusMatchEntry_t) ||
+        hdr->stringsOffset > size || hdr->stringsLen > size - hdr->stringsOffset) {
+        LOG("WARNING - ja4plusMatchDB %s isn't a ja4plus-db file for this byte order", file);
+        ja4plus_match_free(db);
+        return NULL;
+    }
+
+    db->entries = (const JA4PlusMatchEntry_t *)(data + hdr->entriesOffset);
+    db->strings = data + hdr->stringsOffset;
+
+    // Everything is checked once here so lookups don't need to
+    for (uint32_t i = 0; i < hdr->count; i++) {
+        const JA4PlusMatchEntry_t *entry = &db->entries[i];
+        if (entry->type == 0 || entry->type >= JA4PLUS_MATCH_TYPES ||
+            entry->fpOffset > hdr->stringsLen || entry->fpLen > hdr->stringsLen - entry->fpOffset ||
+            entry->labelOffset >= hdr->stringsLen || entry->labelLen >= hdr->stringsLen - entry->labelOffset ||
+            db->strings[entry->labelOffset + entry->labelLen] != 0) {
+            LOG("WARNING - ja4plusMatchDB %s entry %u is bad", file, i);
+            ja4plus_match_free(db);
+            return NULL;
+        }
+    }
+
+    uint32_t slots = 16;
+    while (slots < hdr->count * 2)
+        slots <<= 1;
+    db->slots = g_malloc0(slots * sizeof(JA4PlusMatchSlot_t));
+    db->mask = slots - 1;
+
+    for (uint32_t i = 0; i < hdr->count; i++) {
+        const JA4PlusMatchEntry_t *entry = &db->entries[i];
+        uint64_t pos;
+        uint32_t check;
+
+        ja4plus_match_key(entry->type, db->strings + entry->fpOffset, entry->fpLen, &pos, &check);
+        while (db->slots[pos & db->mask].entry)
+            pos++;
+
+        JA4PlusMatchSlot_t *slot = &db->slots[pos & db->mask];
+        slot->check = check;
+        slot->entry = i + 1;
+        slot->stopSaving = stopSavingLabels && g_hash_table_contains(stopSavingLabels, db->strings + entry->labelOffset);
+    }
+
+    LOG("JA4+ match db %s loaded with %u fingerprints", file, hdr->count);
+    return db;
+}
+/******************************************************************************/
+/* Swap in the file if it changed since it was loaded */
+LOCAL gboolean ja4plus_match_reload(gpointer UNUSED(user_data))
+{
+    struct stat st;
+    if (stat(ja4plusMatchFile, &st) != 0)
+        return TRUE;
+
+    if (matchDB && st.st_ino == matchDB->st.st_ino && st.st_size == matchDB->st.st_size &&
+        st.st_mtim.tv_sec == matchDB->st.st_mtim.tv_sec && st.st_mtim.tv_nsec == matchDB->st.st_mtim.tv_nsec)
+        return TRUE;
+
+    JA4PlusMatchDB_t *db = ja4plus_match_load(ja4plusMatchFile);
+    if (!db)
+        return TRUE;
+
+    JA4PlusMatchDB_t *old = matchDB;
+    g_atomic_pointer_set(&matchDB, db);
+    if (old)
+        arkime_free_later(old, (GDestroyNotify)ja4plus_match_free);
+    return TRUE;
+}
+/******************************************************************************/
+/* Tag the session with the label if the fingerprint is in the database */
+LOCAL void ja4plus_match(ArkimeSession_t *session, int type, const char *fp, int len)
+{
+    LOCAL const uint8_t statIdx[JA4PLUS_MATCH_TYPES] = {0, JA4PLUS_IDX_JA4S, JA4PLUS_IDX_JA4X, JA4PLUS_IDX_JA4H, JA4PLUS_IDX_JA4T, JA4PLUS_IDX_JA4T};
+
+    const JA4PlusMatchDB_t *db = g_atomic_pointer_get(&matchDB);
+    if (!db)
+        return;
+
+    uint64_t pos;
+    uint32_t check;
+    ja4plus_match_key(type, fp, len, &pos, &check);
+
+    for (;; pos++) {
+        const JA4PlusMatchSlot_t *slot = &db->slots[pos & db->mask];
+        if (!slot->entry)
+            return;
+        if (slot->check != check)
+            continue;
+
+        const JA4PlusMatchEntry_t *entry = &db->entries[slot->entry - 1];
+        if (entry->type != type || entry->fpLen != len || memcmp(db->strings + entry->fpOffset, fp, len) != 0)
+            continue;
+
+        arkime_session_add_tag(session, db->strings + entry->labelOffset);
+        stats[session->thread].counts[statIdx[type]][JA4PLUS_STAT_MATCHED]++;
+
+        // Only lowers it so a rule asking for fewer packets still wins
+        if (slot->stopSaving) {
+            uint32_t stop = session->packets[0] + session->packets[1] + ja4plusStopSavingAfter;
+            if (stop < session->stopSaving)
+                session->stopSaving = stop;
+            stats[session->thread].counts[statIdx[type]][JA4PLUS_STAT_STOPPED]++;
+        }
+        return;
+    }
+}
+/******************************************************************************/
+LOCAL void ja4plus_match_init()
+{
+    ja4plusMatchFile = arkime_config_str(NULL, "ja4plusMatchDB", NULL);
+    if (!ja4plusMatchFile)
+        return;
+
+    char *labels = arkime_config_str(NULL, "ja4plusStopSaving", NULL);
+    if (labels) {
+        stopSavingLabels = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        gchar **list = g_strsplit_set(labels, ";,", 0);
+        for (int i = 0; list[i]; i++) {
+            const char *label = g_strstrip(list[i]);
+            if (*label)
+                g_hash_table_add(stopSavingLabels, g_strdup(label));
+        }
+        g_strfreev(list);
+        g_free(labels);
+
+        // Enough for the rest of a TLS handshake after a ja4t/ja4ts match
+        ja4plusStopSavingAfter = arkime_config_int(NULL, "ja4plusStopSavingAfter", 10, 0, 0xfffe);
+    }
+
+    matchDB = ja4plus_match_load(ja4plusMatchFile);
+    if (!matchDB)
+        CONFIGEXIT("Couldn't load ja4plusMatchDB %s", ja4plusMatchFile);
+
+    ja4plusMatchReload = arkime_config_int(NULL, "ja4plusMatchReload", 60, 0, 24 * 3600);
+    if (ja4plusMatchReload)
+        g_timeout_add_seconds(ja4plusMatchReload, ja4plus_match_reload, NULL);
+}
+/******************************************************************************/
+/* Raw fields seen recently
+ *
+ * With ja4plusRawFirstSeen set a raw field is only added the first time its
+ * fingerprint is seen in that many seconds, and for one in ja4plusRawSample
+ * of the repeats. The fingerprint field itself is always added.
+ *
+ * The seen set is a Bloom filter shared by the packet threads, in two
+ * generations. A fingerprint is seen if it is in either and is always set in
+ * the current one. Every ja4plusRawFirstSeen seconds the older one is cleared
+ * and becomes the current, so a fingerprint is forgotten one to two windows
+ * after it was last seen. Bits are only written when not already set, so
+ * common fingerprints don't bounce cache lines between threads, and a lost
+ * race only means an extra raw field.
+ */
+#define JA4PLUS_SEEN_HASHES     4
+
+typedef struct {
+    uint32_t           tick;
+} __attribute__((aligned(64))) JA4PlusSeenTick_t;
+
+LOCAL uint64_t              *seenBits[2];
+LOCAL uint32_t               seenCurrent;
+LOCAL uint64_t               seenMask;          // bits - 1
+LOCAL JA4PlusSeenTick_t      seenTicks[ARKIME_MAX_PACKET_THREADS];
+LOCAL int                    ja4plusRawFirstSeen;
+LOCAL uint32_t               ja4plusRawSample;
+
+/******************************************************************************/
+/* Should the raw field for this fingerprint be added */
+LOCAL gboolean ja4plus_raw_wanted(const ArkimeSession_t *session, int idx, const char *fp, int len)
+{
+    if (!ja4plusRawFirstSeen)
+        return TRUE;
+
+    uint64_t digest[2];
+    ja4plus_digest128((const uint8_t *)fp, len, digest);
+
+    uint32_t  current = __atomic_load_n(&seenCurrent, __ATOMIC_ACQUIRE);
+    uint64_t *bits = seenBits[current];
+    uint64_t *older = seenBits[!current];
+    gboolean  seen = TRUE;
+    gboolean  seenOlder = TRUE;
+
+    for (int i = 0; i < JA4PLUS_SEEN_HASHES; i++) {
+        uint64_t bit = (digest[0] + i * digest[1]) & seenMask;
+        uint64_t mask = 1ULL << (bit & 63);
+
+        if (!(__atomic_load_n(&bits[bit >> 6], __ATOMIC_RELAXED) & mask)) {
+            __atomic_fetch_or(&bits[bit >> 6], mask, __ATOMIC_RELAXED);
+            seen = FALSE;
+        }
+        if (seenOlder && !(__atomic_load_n(&older[bit >> 6], __ATOMIC_RELAXED) & mask))
+            seenOlder = FALSE;
+    }
+
+    if (!seen && !seenOlder)
+        return TRUE;
+
+    if (ja4plusRawSample && ++seenTicks[session->thread].tick >= ja4plusRawSample) {
+        seenTicks[session->thread].tick = 0;
+        return TRUE;
+    }
+
+    stats[session->thread].counts[idx][JA4PLUS_STAT_RAW_SEEN]++;
+    return FALSE;
+}
+/******************************************************************************/
+/* Forget what was only seen in the older window */
+LOCAL gboolean ja4plus_raw_seen_timer(gpointer UNUSED(user_data))
+{
+    uint32_t next = !seenCurrent;
+
+    memset(seenBits[next], 0, (seenMask + 1) / 8);
+    __atomic_store_n(&seenCurrent, next, __ATOMIC_RELEASE);
+    return TRUE;
+}
+/******************************************************************************/
+LOCAL void ja4plus_raw_seen_init()
+{
+    ja4plusRawFirstSeen = arkime_config_int(NULL, "ja4plusRawFirstSeen", 0, 0, 7 * 24 * 3600);
+    if (!ja4plusRawFirstSeen || !ja4plusRaw)
+        return;
+
+    ja4plusRawSample = arkime_config_int(NULL, "ja4plusRawSample", 0, 0, 1000000);
+
+    // Rounded down to a power of 2, 512KB is 4M bits per generation
+    uint64_t kbytes = arkime_config_int(NULL, "ja4plusRawSeenSize", 512, 8, 1024 * 1024);
+    uint64_t bits = 1ULL << (63 - __builtin_clzll(kbytes * 8192));
+    seenMask = bits - 1;
+    seenBits[0] = g_malloc0(bits / 8);
+    seenBits[1] = g_malloc0(bits / 8);
+
+    g_timeout_add_seconds(ja4plusRawFirstSeen, ja4plus_raw_seen_timer, NULL);
+}
+
+/******************************************************************************/
+LOCAL inline int ja4plus_cookie_cmp(const char *base, const JA4PlusCookie_t *a, const JA4PlusCookie_t *b)
+{
+    if (a->prefix != b->prefix)
+        return a->prefix < b->prefix ? -1 : 1;
+
+    if (a->flen > 8 && b->flen > 8) {
+        int cmp = memcmp(base + a->field + 8, base + b->field + 8, MIN(a->flen, b->flen) - 8);
+        if (cmp)
+            return cmp;
+    }
+    return (int)a->flen - (int)b->flen;
+}
+/******************************************************************************/
+/* Stable sort of the cookies by name, insertion sort for small runs and
+ * merge sort above that, tmp must have room for num / 2 cookies.
+ */
+LOCAL void ja4plus_cookie_sort(const char *base, JA4PlusCookie_t *cookies, JA4PlusCookie_t *tmp, uint32_t num)
+{
+    if (num <= 16) {
+        for (uint32_t i = 1; i < num; i++) {
+            JA4PlusCookie_t cookie = cookies[i];
+            uint32_t j = i;
+            while (j > 0 && ja4plus_cookie_cmp(base, &cookies[j - 1], &cookie) > 0) {
+                cookies[j] = cookies[j - 1];
+                j--;
             }
+            cookies[j] = cookie;
+        }
+        return;
+    }
+
+    uint32_t half = num / 2;
+    ja4plus_cookie_sort(base, cookies, tmp, half);
+    ja4plus_cookie_sort(base, cookies + half, tmp, num - half);
+
+    if (ja4plus_cookie_cmp(base, &cookies[half - 1], &cookies[half]) <= 0)
+        return;
+
+    memcpy(tmp, cookies, half * sizeof(JA4PlusCookie_t));
+    uint32_t i = 0, j = half, k = 0;
+    while (i < half && j < num) {
+        if (ja4plus_cookie_cmp(base, &tmp[i], &cookies[j]) <= 0)
+            cookies[k++] = tmp[i++];
+        else
+            cookies[k++] = cookies[j++];
+    }
+    while (i < half)
+        cookies[k++] = tmp[i++];
+}
+/******************************************************************************/
+/* Tokenize the saved cookie header and build the sorted field and field=value
+ * lists into the per thread arena. Returns the number of cookies.
+ */
+LOCAL uint32_t ja4plus_http_process_cookies(int thread, const GString *cookie_value)
+{
+    JA4PlusCookieArena_t *arena = &cookieArenas[thread];
+    const char *base = cookie_value->str;
+    const char *start = base;
+    const char *end = start + cookie_value->len;
+    uint32_t num = 0;
+
+    while (start < end) {
+        while (start < end && isspace(*start)) start++;
+        char *equal = memchr(start, '=', end - start);
+        if (!equal)
+            break;
+
+        if (num == arena->size) {
+            arena->size *= 2;
+            arena->cookies = g_realloc(arena->cookies, arena->size * sizeof(JA4PlusCookie_t));
+            arena->tmp = g_realloc(arena->tmp, arena->size / 2 * sizeof(JA4PlusCookie_t));
+        }
+
+        JA4PlusCookie_t *cookie = &arena->cookies[num];
+        cookie->field = start - base;
+        cookie->flen = equal - start;
+
+        uint8_t prefix[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        memcpy(prefix, start, MIN(cookie->flen, 8));
+        cookie->prefix = (uint64_t)prefix[0] << 56 | (uint64_t)prefix[1] << 48 | (uint64_t)prefix[2] << 40 | (uint64_t)prefix[3] << 32 |
+                         (uint64_t)prefix[4] << 24 | (uint64_t)prefix[5] << 16 | (uint64_t)prefix[6] << 8 | (uint64_t)prefix[7];
+
+        start = memchr(equal + 1, ';', end - (equal + 1));
+        equal++;
+        while (equal < end && isspace(*equal)) equal++;
+        if (equal < end && equal != start) {
+            cookie->value = equal - base;
+            cookie->vlen = start ? start - equal : end - equal;
+        } else {
+            cookie->value = 0;
+            cookie->vlen = 0;
+        }
+        num++;
+
+        if (!start)
+            break;
+        start++;
+    }
+
+    if (num == 0)
+        return 0;
+
+    ja4plus_cookie_sort(base, arena->cookies, arena->tmp, num);
+
+    GString *fields = arena->fields;
+    GString *values = arena->values;
+    g_string_truncate(fields, 0);
+    g_string_truncate(values, 0);
+    for (uint32_t i = 0; i < num; i++) {
+        const JA4PlusCookie_t *cookie = &arena->cookies[i];
+        if (i > 0) {
+            g_string_append_c(fields, ',');
+            g_string_append_c(values, ',');
+        }
+        g_string_append_len(fields, base + cookie->field, cookie->flen);
+        g_string_append_len(values, base + cookie->field, cookie->flen);
+
+        if (cookie->vlen) {
+            g_string_append_c(values, '=');
+            g_string_append_len(values, base + cookie->value, cookie->vlen);
         }
-    } else if (ja4_http->state == 'a') {
-        const char *lang = ja4_http->header_value->str;
+    }
+    return num;
+}
+/******************************************************************************/
+/* Actually process the accept-language header that has been saved up, cookies
+ * are processed once the message is complete.
+ */
+LOCAL void ja4plus_http_process_headers (ArkimeSession_t *session)
+{
+    JA4PlusData_t *ja4_http = (JA4PlusData_t *) session->pluginData[ja4plus_plugin_num];
+    GString       *header_value = ja4_http->http->header_value;
+
+    if (ja4_http->state == 'a') {
+        const char *lang = header_value->str;
         size_t l = 0, a = 0;;
-        while (l < ja4_http->header_value->len && a < 4) {
+        while (l < header_value->len && a < 4) {
             if (isspace(lang[l]) || lang[l] == '-') {
                 l++;
                 continue;
@@ -181,7 +1502,35 @@ LOCAL void ja4plus_http_process_headers (ArkimeSession_t *session)
     }
 
     ja4_http->state = 0;
-    g_string_truncate(ja4_http->header_value, 0);
+    if (header_value)
+        g_string_truncate(header_value, 0);
+}
+/******************************************************************************/
+/* Cheap digest of everything a ja4h is made from, so a repeated request can
+ * be spotted without sorting cookies or any sha256.
+ */
+LOCAL void ja4plus_http_digest(const JA4PlusData_t *ja4_http, const http_parser *parser, const uint32_t headerState[8], uint64_t digest[2])
+{
+    const JA4PlusHTTPBufs_t *bufs = ja4_http->http;
+    uint64_t h[2], c[2] = {0, 0};
+    uint32_t lang;
+
+    // When streaming the header names are already hashed
+    if (bufs->header_fields) {
+        ja4plus_digest128((const uint8_t *)bufs->header_fields->str, bufs->header_fields->len, h);
+    } else {
+        h[0] = (uint64_t)headerState[0] << 32 | headerState[1];
+        h[1] = (uint64_t)headerState[2] << 32 | headerState[3];
+    }
+    if (bufs->cookie_value && bufs->cookie_value->len > 0)
+        ja4plus_digest128((const uint8_t *)bufs->cookie_value->str, bufs->cookie_value->len, c);
+
+    memcpy(&lang, ja4_http->accept_lang, 4);
+    uint64_t small = (uint64_t)parser->method << 56 | (uint64_t)(parser->http_major & 0xff) << 48 |
+                     (uint64_t)(parser->http_minor & 0xff) << 40 | (uint64_t)ja4_http->referer << 32 | lang;
+
+    digest[0] = ja4plus_mix64(h[0] ^ (c[0] * 0x9e3779b97f4a7c15ULL) ^ small);
+    digest[1] = ja4plus_mix64(h[1] + c[1] + ja4_http->headers);
 }
 /******************************************************************************/
 /* An http msg is complete, process the headers and create the ja4h */
@@ -190,81 +1539,135 @@ LOCAL void ja4plus_http_complete(ArkimeSession_t *session, http_parser *parser)
     if (parser->type != 0)
         return;
 
-    JA4PlusData_t *ja4plus_data = (JA4PlusData_t *) session->pluginData[ja4plus_plugin_num];
-    if (!ja4plus_data)
-        return;
-
-    JA4PlusHTTP_t *ja4_http = ja4plus_data->http;
+    JA4PlusData_t *ja4_http = (JA4PlusData_t *) session->pluginData[ja4plus_plugin_num];
     if (!ja4_http)
         return;
 
-    char ja4h[52];
-
-    if (!ja4_http->header_fields)
+    JA4PlusHTTPBufs_t *bufs = ja4_http->http;
+    if (!bufs)
         return;
 
+    JA4PlusFP_t ja4h;
+    JA4PlusCookieArena_t *arena = &cookieArenas[session->thread];
+
     if (ja4_http->state != 0) {
         ja4plus_http_process_headers(session);
     }
 
-    char *method = g_ascii_strdown(http_method_str(parser->method), 2);
-    GChecksum *const checksum = checksums256[session->thread];
-    snprintf(ja4h, sizeof(ja4h), "%s%d%d%c%c%02d%4.4s_",
-             method,
-             parser->http_major,
-             parser->http_minor,
-             (ja4_http->cookies == 0) ? 'n' : 'c',
-             (ja4_http->referer == 0) ? 'n' : 'r',
-             ja4_http->headers,
-             ja4_http->accept_lang
-            );
+    uint32_t headerState[8];
+    if (!bufs->header_fields) {
+        if (ja4_http->headers == 0)
+            ja4plus_sha256_init(&bufs->headerHash);
+        ja4plus_sha256_final(&bufs->headerHash, headerState);
+    }
+
+    // Same inputs as the last request and its ja4h is still pending
+    uint64_t digest[2];
+    ja4plus_http_digest(ja4_http, parser, headerState, digest);
+    if (bufs->lastPending && digest[0] == bufs->lastDigest[0] && digest[1] == bufs->lastDigest[1]) {
+        JA4PLUS_STAT(session->thread, JA4H, CACHE_HIT);
+        goto reset;
+    }
+
+    if (ja4plusJA4hMax && bufs->ja4hDistinct >= ja4plusJA4hMax) {
+        JA4PLUS_STAT(session->thread, JA4H, SKIPPED);
+        goto reset;
+    }
+
+    bufs->lastDigest[0] = digest[0];
+    bufs->lastDigest[1] = digest[1];
+    bufs->lastPending = 1;
 
-    g_checksum_update(checksum, (guchar *)ja4_http->header_fields->str, ja4_http->header_fields->len);
-    memcpy(ja4h + 13, g_checksum_get_string(checksum), 12);
-    g_checksum_reset(checksum);
-    ja4h[25] = '_';
+    if (bufs->cookie_value && bufs->cookie_value->len > 0) {
+        ja4_http->cookies = ja4plus_http_process_cookies(session->thread, bufs->cookie_value);
+    }
 
+    // The a part, the hashes always start at 13 even if this is longer
+    char prefix[32];
+    char *p = prefix;
+    memcpy(p, ja4plus_http_methods[parser->method], 2);
+    p += 2;
+    p += ja4plus_fmt_u32(p, parser->http_major);
+    p += ja4plus_fmt_u32(p, parser->http_minor);
+    *(p++) = (ja4_http->cookies == 0) ? 'n' : 'c';
+    *(p++) = (ja4_http->referer == 0) ? 'n' : 'r';
+    p += ja4plus_fmt_02u(p, ja4_http->headers);
+    memcpy(p, ja4_http->accept_lang, 4);
+    p += 4;
+    *(p++) = '_';
+    int prefixLen = p - prefix;
+    memcpy(ja4h.prefix, prefix, 13);
+    ja4h.prefixLen = 13;
+    ja4h.numHash = 3;
+    ja4h.hash[1] = ja4h.hash[2] = 0;
+
+    JA4PlusHashJob_t jobs[3];
+    int numJobs = 0;
+    if (bufs->header_fields) {
+        jobs[numJobs++] = (JA4PlusHashJob_t) {bufs->header_fields->str, bufs->header_fields->len, NULL, &ja4h.hash[0]};
+    } else {
+        ja4h.hash[0] = ja4plus_hash48(headerState);
+    }
     if (ja4_http->cookies) {
-        g_checksum_update(checksum, (guchar *) ja4_http->sorted_cookie_fields, strlen(ja4_http->sorted_cookie_fields));
-        memcpy(ja4h + 26, g_checksum_get_string(checksum), 12);
-        g_checksum_reset(checksum);
-        ja4h[38] = '_';
-
-        g_checksum_update(checksum, (guchar *) ja4_http->sorted_cookie_values, strlen(ja4_http->sorted_cookie_values));
-        memcpy(ja4h + 39, g_checksum_get_string(checksum), 12);
-        g_checksum_reset(checksum);
+        jobs[numJobs++] = (JA4PlusHashJob_t) {arena->fields->str, arena->fields->len, NULL, &ja4h.hash[1]};
+        jobs[numJobs++] = (JA4PlusHashJob_t) {arena->values->str, arena->values->len, NULL, &ja4h.hash[2]};
+    }
+    ja4plus_hash12_many(jobs, numJobs);
+
+    // Requests on a session often repeat, only keep the new ones
+    gboolean isNew = TRUE;
+    for (int i = 0; i < bufs->ja4hNum; i++) {
+        if (ja4plus_fp_equal(&bufs->ja4h[i], &ja4h)) {
+            isNew = FALSE;
+            break;
+        }
+    }
+
+    if (isNew) {
+        if (bufs->ja4hDistinct < 0xffff)
+            bufs->ja4hDistinct++;
+        if (bufs->ja4hNum == bufs->ja4hSize) {
+            bufs->ja4hSize = bufs->ja4hSize ? bufs->ja4hSize * 2 : 4;
+            bufs->ja4h = g_realloc(bufs->ja4h, bufs->ja4hSize * sizeof(JA4PlusFP_t));
+        }
+        bufs->ja4h[bufs->ja4hNum++] = ja4h;
+        JA4PLUS_STAT(session->thread, JA4H, PRODUCED);
+
+        // The text is otherwise only made at save
+        if (matchDB) {
+            char text[52];
+            ja4plus_match(session, JA4PLUS_MATCH_JA4H, text, ja4plus_fp_format(&ja4h, text));
+        }
     } else {
-        g_strlcpy(ja4h + 26, "000000000000_000000000000", sizeof(ja4h) - 26);
+        JA4PLUS_STAT(session->thread, JA4H, SKIPPED);
     }
-    ja4h[51] = 0;
-    arkime_field_string_add(ja4hField, session, ja4h, 51, TRUE);
 
-    if (ja4Raw) {
+    // Seen recently is checked on the binary form, that has the same hashes
+    if (isNew && (ja4plusRaw & JA4PLUS_FP_JA4H) &&
+        ja4plus_raw_wanted(session, JA4PLUS_IDX_JA4H, (const char *)&ja4h, offsetof(JA4PlusFP_t, prefix) + ja4h.prefixLen)) {
         char ja4h_r[1024];
+        const int size = sizeof(ja4h_r) - 1;
+        int len;
+
+        len = ja4plus_fmt_append(ja4h_r, 0, size, prefix, prefixLen);
+        len = ja4plus_fmt_append(ja4h_r, len, size, bufs->header_fields->str, bufs->header_fields->len);
+        len = ja4plus_fmt_append(ja4h_r, len, size, "_", 1);
+        if (ja4_http->cookies)
+            len = ja4plus_fmt_append(ja4h_r, len, size, arena->fields->str, arena->fields->len);
+        len = ja4plus_fmt_append(ja4h_r, len, size, "_", 1);
+        if (ja4_http->cookies)
+            len = ja4plus_fmt_append(ja4h_r, len, size, arena->values->str, arena->values->len);
+        if (len == size)
+            JA4PLUS_STAT(session->thread, JA4H, TRUNCATED);
+        arkime_field_string_add(ja4hRawField, session, ja4h_r, len, TRUE);
+    }
 
-        snprintf(ja4h_r, sizeof(ja4h_r), "%s%d%d%c%c%02d%4.4s_%s_%s_%s",
-                 method,
-                 parser->http_major,
-                 parser->http_minor,
-                 (ja4_http->cookies == 0) ? 'n' : 'c',
-                 (ja4_http->referer == 0) ? 'n' : 'r',
-                 ja4_http->headers,
-                 ja4_http->accept_lang,
-                 ja4_http->header_fields->str,
-                 (ja4_http->sorted_cookie_fields != NULL) ? ja4_http->sorted_cookie_fields : "",
-                 (ja4_http->sorted_cookie_values != NULL) ? ja4_http->sorted_cookie_values : ""
-                );
-        ja4h_r[sizeof(ja4h_r) - 1] = 0;
-        arkime_field_string_add(ja4hRawField, session, ja4h_r, -1, TRUE);
-    }
-    g_free(method);
-    g_string_truncate(ja4_http->header_fields, 0);
-
-    g_free(ja4_http->sorted_cookie_fields);
-    ja4_http->sorted_cookie_fields = 0;
-
-    g_free(ja4_http->sorted_cookie_values);
-    ja4_http->sorted_cookie_values = 0;
+reset:
+    if (bufs->header_fields)
+        g_string_truncate(bufs->header_fields, 0);
+    if (bufs->cookie_value)
+        g_string_truncate(bufs->cookie_value, 0);
+    ja4plus_http_account(session->thread, bufs);
 
     // Reset
     ja4_http->state = 0;
@@ -274,21 +1677,61 @@ LOCAL void ja4plus_http_complete(ArkimeSession_t *session, http_parser *parser)
     ja4_http->headers = 0;
 }
 /******************************************************************************/
+/* Lower case the ASCII upper case letters in 8 bytes at once, all other bytes
+ * are left alone, which matches g_ascii_strdown.
+ */
+LOCAL inline uint64_t ja4plus_swar_ascii_lower(uint64_t x)
+{
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t high = 0x8080808080808080ULL;
+
+    uint64_t heptets = x & ~high;
+    uint64_t ge_A = heptets + (0x80 - 'A') * ones;
+    uint64_t gt_Z = heptets + (0x7f - 'Z') * ones;
+    uint64_t upper = ~x & (ge_A ^ gt_Z) & high;
+    return x | (upper >> 2);
+}
+/******************************************************************************/
+/* Case insensitive compare of len bytes of str against an already lower case
+ * string, without allocating.
+ */
+LOCAL gboolean ja4plus_ascii_lower_eq(const char *str, const char *lower, size_t len)
+{
+    uint64_t a, b;
+
+    while (len >= 8) {
+        memcpy(&a, str, 8);
+        memcpy(&b, lower, 8);
+        if (ja4plus_swar_ascii_lower(a) != b)
+            return FALSE;
+        str += 8;
+        lower += 8;
+        len -= 8;
+    }
+
+    if (len > 0) {
+        a = b = 0;
+        memcpy(&a, str, len);
+        memcpy(&b, lower, len);
+        if (ja4plus_swar_ascii_lower(a) != b)
+            return FALSE;
+    }
+    return TRUE;
+}
+/******************************************************************************/
 LOCAL void ja4plus_http_header_field_raw (ArkimeSession_t *session, http_parser *hp, const char *at, size_t length)
 {
     if (!at || hp->type != 0)
         return;
 
-    JA4PlusData_t *ja4plus_data = (JA4PlusData_t *) session->pluginData[ja4plus_plugin_num];
-    if (!ja4plus_data) {
-        ja4plus_data = session->pluginData[ja4plus_plugin_num] = ARKIME_TYPE_ALLOC0 (JA4PlusData_t);
+    JA4PlusData_t *ja4_http = (JA4PlusData_t *) session->pluginData[ja4plus_plugin_num];
+    if (!ja4_http) {
+        ja4_http = session->pluginData[ja4plus_plugin_num] = ja4plus_data_alloc(session->thread);
     }
 
-    JA4PlusHTTP_t *ja4_http = ja4plus_data->http;
-    if (!ja4plus_data->http) {
-        ja4_http = ja4plus_data->http = ARKIME_TYPE_ALLOC0 (JA4PlusHTTP_t);
-        ja4_http->header_value = g_string_sized_new(100);
-        ja4_http->header_fields = g_string_sized_new(100);
+    JA4PlusHTTPBufs_t *bufs = ja4_http->http;
+    if (!bufs) {
+        bufs = ja4_http->http = ja4plus_http_alloc(session->thread);
         memcpy(ja4_http->accept_lang, "0000", 4);
     }
 
@@ -296,24 +1739,37 @@ LOCAL void ja4plus_http_header_field_raw (ArkimeSession_t *session, http_parser
         ja4plus_http_process_headers(session);
     }
 
-    char *header_field = g_ascii_strdown(at, length);
-    if (strcmp(header_field, "cookie") == 0) {
+    if (length == 6 && ja4plus_ascii_lower_eq(at, "cookie", 6)) {
+        // Only the last cookie header is used
+        if (!bufs->cookie_value)
+            bufs->cookie_value = g_string_sized_new(100);
+        else
+            g_string_truncate(bufs->cookie_value, 0);
         ja4_http->state = 'c';
-    } else if (strcmp(header_field, "referer") == 0) {
+    } else if (length == 7 && ja4plus_ascii_lower_eq(at, "referer", 7)) {
         ja4_http->referer = 1;
     } else {
-        if (ja4_http->headers > 0) {
-            g_string_append_len(ja4_http->header_fields, ",", 1);
+        if (!bufs->header_fields) {
+            if (ja4_http->headers == 0)
+                ja4plus_sha256_init(&bufs->headerHash);
+            else
+                ja4plus_sha256_update(&bufs->headerHash, ",", 1);
+            ja4plus_sha256_update(&bufs->headerHash, at, length);
+        } else {
+            if (ja4_http->headers > 0) {
+                g_string_append_len(bufs->header_fields, ",", 1);
+            }
+            g_string_append_len(bufs->header_fields, at, length);
         }
-        g_string_append_len(ja4_http->header_fields, at, length);
         ja4_http->headers++;
-        if (strcmp(header_field, "accept-language") == 0) {
+        if (length == 15 && ja4plus_ascii_lower_eq(at, "accept-language", 15)) {
+            if (!bufs->header_value)
+                bufs->header_value = g_string_sized_new(100);
             ja4_http->state = 'a';
         } else {
             ja4_http->state = 0;
         }
     }
-    g_free(header_field);
 }
 /******************************************************************************/
 /* New partial value is coming in, append it to the current value if we are in a cookie/accept-language */
@@ -322,13 +1778,15 @@ LOCAL void ja4plus_http_header_value (ArkimeSession_t *session, http_parser *hp,
     if (!at || hp->type != 0)
         return;
 
-    JA4PlusData_t *ja4plus_data = (JA4PlusData_t *) session->pluginData[ja4plus_plugin_num];
-    JA4PlusHTTP_t *ja4_http = ja4plus_data->http;
+    JA4PlusData_t *ja4_http = (JA4PlusData_t *) session->pluginData[ja4plus_plugin_num];
 
     if (ja4_http->state == 0)
         return;
 
-    g_string_append_len(ja4_http->header_value, at, length);
+    if (ja4_http->state == 'c')
+        g_string_append_len(ja4_http->http->cookie_value, at, length);
+    else
+        g_string_append_len(ja4_http->http->header_value, at, length);
 }
 /******************************************************************************/
 // https://tools.ietf.org/html/draft-davidben-tls-grease-00
@@ -376,6 +1834,70 @@ LOCAL void ja4plus_ja4_version(uint16_t ver, char vstr[3])
     }
 }
 /******************************************************************************/
+/* Add the finished ja4s and ja4s_r fields, remembering them in the cache if
+ * keyLen is set.
+ */
+LOCAL void ja4plus_ja4s_add(ArkimeSession_t *session, const char *ja4s, const char *exts, int len, const uint64_t digest[2], int keyLen)
+{
+    char ja4s_r[13 + 5 * 256];
+
+    JA4PLUS_STAT(session->thread, JA4S, PRODUCED);
+    arkime_field_string_add(ja4sField, session, ja4s, 25, TRUE);
+    ja4plus_match(session, JA4PLUS_MATCH_JA4S, ja4s, 25);
+
+    if (ja4plusRaw & JA4PLUS_FP_JA4S) {
+        memcpy(ja4s_r, ja4s, 13);
+        memcpy(ja4s_r + 13, exts, len);
+
+        if (ja4plus_raw_wanted(session, JA4PLUS_IDX_JA4S, ja4s, 25))
+            arkime_field_string_add(ja4sRawField, session, ja4s_r, 13 + len, TRUE);
+    }
+
+    if (keyLen) {
+        ja4plus_cache_add(&ja4sCaches[session->thread], digest, keyLen, ja4s, 25, (ja4plusRaw & JA4PLUS_FP_JA4S) ? ja4s_r : NULL, 13 + len);
+    }
+}
+/******************************************************************************/
+/* Hash everything waiting in the thread's batch and add the fields */
+LOCAL void ja4plus_ja4s_flush(int thread)
+{
+    JA4PlusHashBatch_t *batch = &hashBatches[thread];
+    JA4PlusHashJob_t    jobs[batch->num];
+
+    for (int i = 0; i < batch->num; i++) {
+        JA4PlusPendingJA4S_t *pending = &batch->pending[i];
+        jobs[i].data = pending->buf;
+        jobs[i].len = pending->len;
+        jobs[i].out = pending->ja4s + 13;
+    }
+
+    ja4plus_hash12_many(jobs, batch->num);
+
+    for (int i = 0; i < batch->num; i++) {
+        JA4PlusPendingJA4S_t *pending = &batch->pending[i];
+        ja4plus_ja4s_add(pending->session, pending->ja4s, pending->buf, pending->len, pending->digest, pending->keyLen);
+    }
+    batch->num = 0;
+}
+/******************************************************************************/
+LOCAL void ja4plus_ja4s_queue(ArkimeSession_t *session, const char *ja4s, const char *exts, int len, const uint64_t digest[2], int keyLen)
+{
+    JA4PlusHashBatch_t *batch = &hashBatches[session->thread];
+    JA4PlusPendingJA4S_t *pending = &batch->pending[batch->num];
+
+    pending->session = session;
+    pending->digest[0] = digest[0];
+    pending->digest[1] = digest[1];
+    pending->keyLen = keyLen;
+    pending->len = len;
+    memcpy(pending->ja4s, ja4s, 26);
+    memcpy(pending->buf, exts, len);
+    batch->num++;
+
+    if (batch->num == ja4plusHashBatch)
+        ja4plus_ja4s_flush(session->thread);
+}
+/******************************************************************************/
 LOCAL uint32_t ja4plus_process_server_hello(ArkimeSession_t *session, const uint8_t *data, int len, void UNUSED(*uw))
 {
     // https://github.com/FoxIO-LLC/ja4/blob/main/technical_details/JA4S.md
@@ -392,8 +1914,10 @@ LOCAL uint32_t ja4plus_process_server_hello(ArkimeSession_t *session, const uint
     supportedver = ver;
     BSB_IMPORT_skip(bsb, 32);     // Random
 
-    if (BSB_IS_ERROR(bsb))
+    if (BSB_IS_ERROR(bsb)) {
+        JA4PLUS_STAT(session->thread, JA4S, FAILED);
         return -1;
+    }
 
     /* Parse sessionid, only for SSLv3 - TLSv1.2 */
     if (ver >= 0x0300 && ver <= 0x0303) {
@@ -404,9 +1928,6 @@ LOCAL uint32_t ja4plus_process_server_hello(ArkimeSession_t *session, const uint
 
     uint16_t cipher = 0;
     BSB_IMPORT_u16(bsb, cipher);
-    char cipherHex[5];
-    snprintf(cipherHex, sizeof(cipherHex), "%04x", cipher);
-
 
     /* Thanks wireshark - No compression with TLS 1.3 before draft -22 */
     if (ver < 0x0700 || ver >= 0x7f16) {
@@ -436,8 +1957,10 @@ LOCAL uint32_t ja4plus_process_server_hello(ArkimeSession_t *session, const uint
             ja4Extensions[ja4NumExtensions] = etype;
             ja4NumExtensions++;
 
-            if (elen > BSB_REMAINING(ebsb))
+            if (elen > BSB_REMAINING(ebsb)) {
+                JA4PLUS_STAT(session->thread, JA4S, TRUNCATED);
                 break;
+            }
 
             if (etype == 0x2b && elen == 2) { // etype 0x2b is supported version
                 BSB_IMPORT_u16(ebsb, supportedver);
@@ -465,6 +1988,34 @@ LOCAL uint32_t ja4plus_process_server_hello(ArkimeSession_t *session, const uint
         }
     }
 
+    // For a given server build everything that goes into the ja4s is the same
+    // every time, so check the cache using all of it as the key
+    uint64_t digest[2] = {0, 0};
+    int      keyLen = 0;
+    if (ja4plusJA4sCacheSize) {
+        uint16_t key[5 + 256];
+        key[0] = supportedver;
+        key[1] = cipher;
+        key[2] = ja4ALPN[0] << 8 | ja4ALPN[1];
+        key[3] = session->ipProtocol;
+        key[4] = ja4NumExtensions;
+        memcpy(key + 5, ja4Extensions, ja4NumExtensions * sizeof(uint16_t));
+        keyLen = (5 + ja4NumExtensions) * sizeof(uint16_t);
+        ja4plus_digest128((uint8_t *)key, keyLen, digest);
+
+        JA4PlusCacheEntry_t *entry = ja4plus_cache_lookup(&ja4sCaches[session->thread], digest, keyLen);
+        if (entry) {
+            JA4PLUS_STAT(session->thread, JA4S, CACHE_HIT);
+            JA4PLUS_STAT(session->thread, JA4S, PRODUCED);
+            arkime_field_string_add(ja4sField, session, entry->fp, entry->fpLen, TRUE);
+            ja4plus_match(session, JA4PLUS_MATCH_JA4S, entry->fp, entry->fpLen);
+            if ((ja4plusRaw & JA4PLUS_FP_JA4S) && entry->raw && ja4plus_raw_wanted(session, JA4PLUS_IDX_JA4S, entry->fp, entry->fpLen)) {
+                arkime_field_string_add(ja4sRawField, session, entry->raw, entry->rawLen, TRUE);
+            }
+            return 0;
+        }
+    }
+
     // JA4s Creation
     char vstr[3];
     ja4plus_ja4_version(supportedver, vstr);
@@ -479,40 +2030,31 @@ LOCAL uint32_t ja4plus_process_server_hello(ArkimeSession_t *session, const uint
     ja4s[5] = ja4ALPN[0];
     ja4s[6] = ja4ALPN[1];
     ja4s[7] = '_';
-    memcpy(ja4s + 8, cipherHex, 4);
+    ja4plus_fmt_hex4(ja4s + 8, cipher);
     ja4s[12] = '_';
 
     char tmpBuf[5 * 256];
-    BSB tmpBSB;
+    int  tmpLen = 0;
 
-    BSB_INIT(tmpBSB, tmpBuf, sizeof(tmpBuf));
     for (int i = 0; i < ja4NumExtensions; i++) {
-        BSB_EXPORT_sprintf(tmpBSB, "%04x,", ja4Extensions[i]);
+        tmpLen += ja4plus_fmt_hex4(tmpBuf + tmpLen, ja4Extensions[i]);
+        tmpBuf[tmpLen++] = ',';
     }
     if (ja4NumExtensions > 0) {
-        BSB_EXPORT_rewind(tmpBSB, 1); // Remove last ,
+        tmpLen--; // Remove last ,
     }
 
-    GChecksum *const checksum = checksums256[session->thread];
-
-    if (BSB_LENGTH(tmpBSB) > 0) {
-        g_checksum_update(checksum, (guchar *)tmpBuf, BSB_LENGTH(tmpBSB));
-        memcpy(ja4s + 13, g_checksum_get_string(checksum), 12);
-        g_checksum_reset(checksum);
+    if (tmpLen > 0) {
+        if (ja4plusHashBatch) {
+            ja4plus_ja4s_queue(session, ja4s, tmpBuf, tmpLen, digest, keyLen);
+            return 0;
+        }
+        ja4plus_hash12(tmpBuf, tmpLen, ja4s + 13);
     } else {
         memcpy(ja4s + 13, "000000000000", 12);
     }
 
-    arkime_field_string_add(ja4sField, session, ja4s, 25, TRUE);
-
-    if (ja4Raw) {
-        char ja4s_r[13 + 5 * 256];
-        memcpy(ja4s_r, ja4s, 13);
-        memcpy(ja4s_r + 13, tmpBuf, BSB_LENGTH(tmpBSB));
-
-        arkime_field_string_add(ja4sRawField, session, ja4s_r, 13 + BSB_LENGTH(tmpBSB), TRUE);
-    }
-
+    ja4plus_ja4s_add(session, ja4s, tmpBuf, tmpLen, digest, keyLen);
     return 0;
 }
 /******************************************************************************/
@@ -540,15 +2082,15 @@ LOCAL void ja4plus_cert_process_rdn(BSB *bsb, BSB *out)
     }
 }
 /******************************************************************************/
-LOCAL void ja4plus_cert_print(int thread, int pos, char *ja4x, BSB *out)
+/* Add the hash job for one part of the ja4x, empty parts are all zeros */
+LOCAL void ja4plus_cert_print(int pos, char *ja4x, BSB *out, JA4PlusHashJob_t *jobs, int *num)
 {
-    GChecksum *const checksum = checksums256[thread];
-
     if (BSB_LENGTH(*out) > 0) {
         BSB_EXPORT_rewind(*out, 1);
-        g_checksum_update(checksum, (guchar *)out->buf, BSB_LENGTH(*out));
-        memcpy(ja4x + (13 * pos), g_checksum_get_string(checksum), 12);
-        g_checksum_reset(checksum);
+        jobs[*num].data = out->buf;
+        jobs[*num].len = BSB_LENGTH(*out);
+        jobs[*num].out = ja4x + (13 * pos);
+        (*num)++;
     } else {
         memcpy(ja4x + (13 * pos), "000000000000", 12);
     }
@@ -560,6 +2102,23 @@ LOCAL uint32_t ja4plus_process_certificate_wInfo(ArkimeSession_t *session, const
 
     uint32_t atag, alen, apc;
     uint8_t *value;
+    uint64_t digest[2] = {0, 0};
+
+    JA4PlusCache_t *cache = ja4plusCertCacheSize ? &certCaches[session->thread] : NULL;
+    if (cache && len > 0) {
+        ja4plus_digest128(data, len, digest);
+        JA4PlusCacheEntry_t *entry = ja4plus_cache_lookup(cache, digest, len);
+        if (entry) {
+            JA4PLUS_STAT(session->thread, JA4X, CACHE_HIT);
+            JA4PLUS_STAT(session->thread, JA4X, PRODUCED);
+            ja4plus_match(session, JA4PLUS_MATCH_JA4X, entry->fp, entry->fpLen);
+            arkime_field_certsinfo_update_extra(uw, g_strdup("ja4x"), g_strndup(entry->fp, entry->fpLen));
+            if ((ja4plusRaw & JA4PLUS_FP_JA4X) && entry->raw && ja4plus_raw_wanted(session, JA4PLUS_IDX_JA4X, entry->fp, entry->fpLen)) {
+                arkime_field_certsinfo_update_extra(uw, g_strdup("ja4x_r"), g_strndup(entry->raw, entry->rawLen));
+            }
+            return 0;
+        }
+    }
 
     BSB      bsb;
     BSB_INIT(bsb, data, len);
@@ -597,25 +2156,23 @@ LOCAL uint32_t ja4plus_process_certificate_wInfo(ArkimeSession_t *session, const
         goto bad_cert;
     }
     BSB out;
-    char outbuf[1000];
+    char outbuf[3][1000];
+    JA4PlusHashJob_t jobs[3];
+    int numJobs = 0;
+    int outLen[3];
+    int truncated = 0;   // a part didn't fit its buffer and is hashed as far as it got
     char ja4x[39];
-    char ja4x_r[1000];
     ja4x[12] = ja4x[25] = '_';
     ja4x[38] = 0;
 
-    BSB ja4x_rbsb;
-    BSB_INIT(ja4x_rbsb, ja4x_r, sizeof(ja4x_r));
-
     BSB tbsb;
     BSB_INIT(tbsb, value, alen);
 
-    BSB_INIT(out, outbuf, sizeof(outbuf));
+    BSB_INIT(out, outbuf[0], sizeof(outbuf[0]));
     ja4plus_cert_process_rdn(&tbsb, &out);
-    if (BSB_LENGTH(out) > 0)
-        BSB_EXPORT_ptr(ja4x_rbsb, out.buf, BSB_LENGTH(out) - 1);
-    BSB_EXPORT_u08(ja4x_rbsb, '_');
-
-    ja4plus_cert_print(session->thread, 0,  ja4x, &out);
+    truncated |= BSB_IS_ERROR(out);
+    ja4plus_cert_print(0, ja4x, &out, jobs, &numJobs);
+    outLen[0] = MAX(0, BSB_LENGTH(out));
 
     /* validity */
     if (!(value = arkime_parsers_asn_get_tlv(&bsb, &apc, &atag, &alen))) {
@@ -637,13 +2194,11 @@ LOCAL uint32_t ja4plus_process_certificate_wInfo(ArkimeSession_t *session, const
     }
     BSB_INIT(tbsb, value, alen);
 
-    BSB_INIT(out, outbuf, sizeof(outbuf));
+    BSB_INIT(out, outbuf[1], sizeof(outbuf[1]));
     ja4plus_cert_process_rdn(&tbsb, &out);
-    if (BSB_LENGTH(out) > 0)
-        BSB_EXPORT_ptr(ja4x_rbsb, out.buf, BSB_LENGTH(out) - 1);
-    BSB_EXPORT_u08(ja4x_rbsb, '_');
-
-    ja4plus_cert_print(session->thread, 1, ja4x, &out);
+    truncated |= BSB_IS_ERROR(out);
+    ja4plus_cert_print(1, ja4x, &out, jobs, &numJobs);
+    outLen[1] = MAX(0, BSB_LENGTH(out));
 
     /* subjectPublicKeyInfo */
     if (!(value = arkime_parsers_asn_get_tlv(&bsb, &apc, &atag, &alen))) {
@@ -651,220 +2206,440 @@ LOCAL uint32_t ja4plus_process_certificate_wInfo(ArkimeSession_t *session, const
     }
 
     /* extensions */
-    BSB_INIT(out, outbuf, sizeof(outbuf));
+    BSB_INIT(out, outbuf[2], sizeof(outbuf[2]));
     ja4plus_cert_process_rdn(&bsb, &out);
-    if (BSB_LENGTH(out) > 0)
-        BSB_EXPORT_ptr(ja4x_rbsb, out.buf, BSB_LENGTH(out) - 1);
-    BSB_EXPORT_u08(ja4x_rbsb, 0);
+    truncated |= BSB_IS_ERROR(out);
+    ja4plus_cert_print(2, ja4x, &out, jobs, &numJobs);
+    outLen[2] = MAX(0, BSB_LENGTH(out));
 
-    ja4plus_cert_print(session->thread, 2, ja4x, &out);
+    ja4plus_hash12_many(jobs, numJobs);
+
+    JA4PLUS_STAT(session->thread, JA4X, PRODUCED);
+    if (truncated)
+        JA4PLUS_STAT(session->thread, JA4X, TRUNCATED);
+    ja4plus_match(session, JA4PLUS_MATCH_JA4X, ja4x, 38);
 
     arkime_field_certsinfo_update_extra(uw, g_strdup("ja4x"), g_strdup(ja4x));
-    if (ja4Raw) {
-        arkime_field_certsinfo_update_extra(uw, g_strdup("ja4x_r"), g_strdup(ja4x_r));
+
+    // The raw string is only built when it is wanted
+    char ja4x_r[sizeof(outbuf) + 3];
+    int  ja4x_rLen = 0;
+    if (ja4plusRaw & JA4PLUS_FP_JA4X) {
+        for (int i = 0; i < 3; i++) {
+            if (i > 0)
+                ja4x_r[ja4x_rLen++] = '_';
+            memcpy(ja4x_r + ja4x_rLen, outbuf[i], outLen[i]);
+            ja4x_rLen += outLen[i];
+        }
+        ja4x_r[ja4x_rLen] = 0;
+        if (ja4plus_raw_wanted(session, JA4PLUS_IDX_JA4X, ja4x, 38))
+            arkime_field_certsinfo_update_extra(uw, g_strdup("ja4x_r"), g_strndup(ja4x_r, ja4x_rLen));
+    }
+
+    if (cache && len > 0) {
+        ja4plus_cache_add(cache, digest, len, ja4x, 38, (ja4plusRaw & JA4PLUS_FP_JA4X) ? ja4x_r : NULL, ja4x_rLen);
     }
     return 0;
 
 bad_cert:
+    JA4PLUS_STAT(session->thread, JA4X, FAILED);
     return 0;
 }
 /******************************************************************************/
-// Given a list of numbers find the mode, we ignore numbers > 2048
-LOCAL int ja4plus_ssh_mode(uint16_t *nums, int num)
+/* JA4ssh
+ *
+ * The ssh parser hands over the payload lengths 200 packets at a time. The
+ * mode of each direction is kept up to date as lengths are added, ties going
+ * to the smaller length, and only the counts that were touched are cleared.
+ * When ja4plusSSHWindow is a larger multiple of 200 the trackers stay with
+ * the session until the window is full, what is left is added at the save.
+ */
+#define JA4PLUS_SSH_LENS      2048
+#define JA4PLUS_SSH_CHUNK     200
+
+typedef struct {
+    uint16_t       counts[JA4PLUS_SSH_LENS];
+    uint16_t       mode;
+    uint16_t       modeCount;
+} JA4PlusModeTracker_t;
+
+struct ja4plus_ssh {
+    JA4PlusModeTracker_t dir[2];
+    uint32_t       packets[2];
+};
+
+LOCAL JA4PlusSSH_t          *sshScratch[ARKIME_MAX_PACKET_THREADS];
+LOCAL int                    ja4plusSSHWindow;
+
+/******************************************************************************/
+/* Returns how many lens were too long to track */
+LOCAL int ja4plus_mode_add(JA4PlusModeTracker_t *tracker, const uint16_t *lens, int num)
 {
-    unsigned char  count[2048];
-    unsigned short mode = 0;
-    unsigned char  modeCount = 0;
-    memset(count, 0, sizeof(count));
+    int skipped = 0;
+
     for (int i = 0; i < num; i++) {
-        if (nums[i] >= 2048)
+        const uint16_t len = lens[i];
+        if (len >= JA4PLUS_SSH_LENS) {
+            skipped++;
             continue;
-        count[nums[i]]++;
-        if (count[nums[i]] == modeCount && nums[i] < mode) {
-            // new count same as old max, but lower mode
-            mode = nums[i];
-        } else if (count[nums[i]] > modeCount) {
-            mode = nums[i];
-            modeCount = count[nums[i]];
         }
 
+        const uint16_t count = ++tracker->counts[len];
+        if (count > tracker->modeCount || (count == tracker->modeCount && len < tracker->mode)) {
+            tracker->mode = len;
+            tracker->modeCount = count;
+        }
+    }
+    return skipped;
+}
+/******************************************************************************/
+/* Undo ja4plus_mode_add for the same lens */
+LOCAL void ja4plus_mode_clear(JA4PlusModeTracker_t *tracker, const uint16_t *lens, int num)
+{
+    for (int i = 0; i < num; i++) {
+        if (lens[i] < JA4PLUS_SSH_LENS)
+            tracker->counts[lens[i]] = 0;
     }
-    return mode;
+    tracker->mode = tracker->modeCount = 0;
+}
+/******************************************************************************/
+LOCAL void ja4plus_ssh_add(ArkimeSession_t *session, const JA4PlusSSH_t *track)
+{
+    char ja4ssh[50];
+    char *p = ja4ssh;
+
+    // c{mode}s{mode}_c{packets}s{packets}_c{acks}s{acks}
+    *(p++) = 'c';
+    p += ja4plus_fmt_u32(p, track->dir[0].mode);
+    *(p++) = 's';
+    p += ja4plus_fmt_u32(p, track->dir[1].mode);
+    memcpy(p, "_c", 2);
+    p += 2;
+    p += ja4plus_fmt_u32(p, track->packets[0]);
+    *(p++) = 's';
+    p += ja4plus_fmt_u32(p, track->packets[1]);
+    memcpy(p, "_c", 2);
+    p += 2;
+    p += ja4plus_fmt_u32(p, session->tcpFlagAckCnt[0]);
+    *(p++) = 's';
+    p += ja4plus_fmt_u32(p, session->tcpFlagAckCnt[1]);
+    session->tcpFlagAckCnt[0] = session->tcpFlagAckCnt[1] = 0;
+
+    JA4PLUS_STAT(session->thread, JA4SSH, PRODUCED);
+    arkime_field_string_add(ja4sshField, session, ja4ssh, p - ja4ssh, TRUE);
 }
 /******************************************************************************/
+/* Called every 200 packets and once more from the ssh parser's save with
+ * whatever is left, so a short session still gets a partial window.
+ */
 LOCAL uint32_t ja4plus_ssh_ja4ssh(ArkimeSession_t *session, const uint8_t *UNUSED(data), int UNUSED(len), void *uw)
 {
     // https://github.com/FoxIO-LLC/ja4/blob/main/technical_details/JA4SSH.md
-    char ja4ssh[50];
-    BSB bsb;
+    SSHInfo_t    *ssh = uw;
+    JA4PlusSSH_t *track;
+    int           tooLong = 0;
+
+    if (ja4plusSSHWindow == JA4PLUS_SSH_CHUNK) {
+        track = sshScratch[session->thread];
+        for (int d = 0; d < 2; d++) {
+            tooLong += ja4plus_mode_add(&track->dir[d], ssh->lens[d], ssh->packets200[d]);
+            track->packets[d] = ssh->packets200[d];
+        }
+        if (tooLong)
+            JA4PLUS_STAT(session->thread, JA4SSH, TRUNCATED);
 
-    SSHInfo_t *ssh = uw;
+        ja4plus_ssh_add(session, track);
 
-    BSB_INIT(bsb, ja4ssh, sizeof(ja4ssh));
-    BSB_EXPORT_sprintf(bsb, "c%ds%d_c%ds%d_c%ds%d",
-                       ja4plus_ssh_mode(ssh->lens[0], ssh->packets200[0]), ja4plus_ssh_mode(ssh->lens[1], ssh->packets200[1]),
-                       ssh->packets200[0], ssh->packets200[1],
-                       session->tcpFlagAckCnt[0], session->tcpFlagAckCnt[1]);
-    session->tcpFlagAckCnt[0] = session->tcpFlagAckCnt[1] = 0;
+        // The scratch trackers only hold this call's lens
+        for (int d = 0; d < 2; d++) {
+            ja4plus_mode_clear(&track->dir[d], ssh->lens[d], ssh->packets200[d]);
+            track->packets[d] = 0;
+        }
+        return 0;
+    }
+
+    JA4PlusData_t *ja4plus_data = session->pluginData[ja4plus_plugin_num];
+    if (!ja4plus_data)
+        ja4plus_data = session->pluginData[ja4plus_plugin_num] = ja4plus_data_alloc(session->thread);
+    if (!ja4plus_data->ssh) {
+        ja4plus_data->ssh = ARKIME_TYPE_ALLOC0(JA4PlusSSH_t);
+        pools[session->thread].bytes += sizeof(JA4PlusSSH_t);
+    }
+    track = ja4plus_data->ssh;
+
+    for (int d = 0; d < 2; d++) {
+        tooLong += ja4plus_mode_add(&track->dir[d], ssh->lens[d], ssh->packets200[d]);
+        track->packets[d] += ssh->packets200[d];
+    }
+    if (tooLong)
+        JA4PLUS_STAT(session->thread, JA4SSH, TRUNCATED);
 
-    arkime_field_string_add(ja4sshField, session, ja4ssh, BSB_LENGTH(bsb), TRUE);
+    // The rest of a window that never fills is added by ja4plus_plugin_save
+    if (track->packets[0] + track->packets[1] >= (uint32_t)ja4plusSSHWindow) {
+        ja4plus_ssh_add(session, track);
+        memset(track, 0, sizeof(*track));
+    }
     return 0;
 }
 /******************************************************************************/
-LOCAL void ja4plus_ja4ts(ArkimeSession_t *session, JA4PlusTCP_t *data, const struct tcphdr *tcph)
+/* The parts of a SYN or SYN/ACK that JA4t and JA4ts are built from */
+typedef struct {
+    uint16_t       window;
+    uint16_t       mss;             // 0xffff if not present
+    uint8_t        window_scale;    // 0xff if not present
+    uint8_t        numOptions;
+    uint8_t        options[40];
+} JA4PlusTCPOptions_t;
+
+/******************************************************************************/
+LOCAL void ja4plus_tcp_options_parse(const struct tcphdr *tcph, JA4PlusTCPOptions_t *opts)
 {
-    uint8_t        *p = (uint8_t *)tcph + 20;
-    const uint8_t  *end = (uint8_t *)tcph + tcph->th_off * 4;
-    uint16_t        mss = 0xffff;
-    uint8_t         window_scale = 0xff;
+    const uint8_t  *p = (const uint8_t *)tcph + 20;
+    const uint8_t  *end = (const uint8_t *)tcph + tcph->th_off * 4;
 
-    char obuf[100];
-    BSB obsb;
+    opts->window = ntohs(tcph->th_win);
+    opts->mss = 0xffff;
+    opts->window_scale = 0xff;
+    opts->numOptions = 0;
 
-    BSB_INIT(obsb, obuf, sizeof(obuf));
-    BSB_EXPORT_sprintf(obsb, "%d_", ntohs(tcph->th_win));
-    if (p == end) {
-        BSB_EXPORT_cstr(obsb, "00");
-    } else {
-        BSB hbsb;
-        BSB_INIT(hbsb, p, (int)(end - p));
-
-        while (BSB_REMAINING(hbsb) > 0 && !BSB_IS_ERROR(hbsb)) {
-            uint8_t next = 0;
-            BSB_IMPORT_u08(hbsb, next);
-            BSB_EXPORT_sprintf(obsb, "%d-", next);
-            if (next == 0) // End of list
-                break;
+    while (p < end) {
+        uint8_t next = *(p++);
+        opts->options[opts->numOptions++] = next;
+        if (next == 0) // End of list
+            break;
 
-            if (next == 1) // NOOP
-                continue;
+        if (next == 1) // NOOP
+            continue;
+
+        if (p >= end)
+            break;
+        uint8_t size = *(p++);
+        if (size < 2 || end - p < size - 2)
+            break;
 
-            uint8_t size = 0;
-            BSB_IMPORT_u08(hbsb, size);
-            if (size < 2 || BSB_REMAINING(hbsb) < size - 2)
+        if (next == 2) {
+            if (end - p < 2)
                 break;
-            if (next == 2)
-                BSB_IMPORT_u16(hbsb, mss);
-            else if (next == 3)
-                BSB_IMPORT_u08(hbsb, window_scale);
-            else
-                BSB_IMPORT_skip(hbsb, size - 2);
+            opts->mss = (p[0] << 8) | p[1];
+            p += 2;
+        } else if (next == 3) {
+            if (p >= end)
+                break;
+            opts->window_scale = *(p++);
+        } else {
+            p += size - 2;
         }
-
-        BSB_EXPORT_rewind(obsb, 1); // remove last -
     }
+}
+/******************************************************************************/
+/* Format the window_options_mss_scale part shared by JA4t and JA4ts, out must
+ * have room for 200 characters. Returns the length, not NUL terminated.
+ */
+LOCAL int ja4plus_tcp_options_format(const JA4PlusTCPOptions_t *opts, char *out)
+{
+    char *p = out;
 
-    if (mss == 0xffff) {
-        BSB_EXPORT_cstr(obsb, "_00");
+    p += ja4plus_fmt_u32(p, opts->window);
+    *(p++) = '_';
+
+    if (opts->numOptions == 0) {
+        memcpy(p, "00", 2);
+        p += 2;
     } else {
-        BSB_EXPORT_sprintf(obsb, "_%d", mss);
+        for (int i = 0; i < opts->numOptions; i++) {
+            p += ja4plus_fmt_u32(p, opts->options[i]);
+            *(p++) = '-';
+        }
+        p--; // remove last -
     }
 
-    if (window_scale == 0xff) {
-        BSB_EXPORT_cstr(obsb, "_00");
+    if (opts->mss == 0xffff) {
+        memcpy(p, "_00", 3);
+        p += 3;
     } else {
-        BSB_EXPORT_sprintf(obsb, "_%d", window_scale);
+        *(p++) = '_';
+        p += ja4plus_fmt_u32(p, opts->mss);
     }
 
-    if (data->synAckTimesCnt > 1) {
-        BSB_EXPORT_cstr(obsb, "_");
-        for (int i = 1; i < data->synAckTimesCnt; i++) {
-            BSB_EXPORT_sprintf(obsb, "%.0f-", round ((data->synAckTimes[i] - data->synAckTimes[i - 1]) / 1000000));
-        }
-        BSB_EXPORT_rewind(obsb, 1); // remove last -
+    if (opts->window_scale == 0xff) {
+        memcpy(p, "_00", 3);
+        p += 3;
+    } else {
+        *(p++) = '_';
+        p += ja4plus_fmt_u32(p, opts->window_scale);
     }
 
-    BSB_EXPORT_u08(obsb, 0);
-    arkime_field_string_add(ja4tsField, session, obuf, -1, TRUE);
+    return p - out;
 }
 /******************************************************************************/
-LOCAL void ja4plus_ja4t(ArkimeSession_t *session, JA4PlusTCP_t UNUSED(*data), const struct tcphdr *tcph)
-{
-    uint8_t        *p = (uint8_t *)tcph + 20;
-    const uint8_t  *end = (uint8_t *)tcph + tcph->th_off * 4;
-    uint16_t        mss = 0xffff;
-    uint8_t         window_scale = 0xff;
-
-    char obuf[100];
-    BSB obsb;
+/* Scans and SYN floods send the same window and options over and over, so
+ * each thread has a small direct mapped cache from the raw window and option
+ * bytes to the formatted string.
+ */
+typedef struct {
+    uint8_t        keyLen;          // 0 if the entry is empty
+    uint8_t        fpLen;
+    uint8_t        key[42];
+    char           fp[200];
+} JA4PlusTCPCacheEntry_t;
 
-    BSB_INIT(obsb, obuf, sizeof(obuf));
-    BSB_EXPORT_sprintf(obsb, "%d_", ntohs(tcph->th_win));
-    if (p == end) {
-        BSB_EXPORT_cstr(obsb, "00");
-    } else {
-        BSB hbsb;
-        BSB_INIT(hbsb, p, (int)(end - p));
-
-        while (BSB_REMAINING(hbsb) > 0 && !BSB_IS_ERROR(hbsb)) {
-            uint8_t next = 0;
-            BSB_IMPORT_u08(hbsb, next);
-            BSB_EXPORT_sprintf(obsb, "%d-", next);
-            if (next == 0) // End of list
-                break;
+typedef struct {
+    JA4PlusTCPCacheEntry_t   *entries;
+    uint32_t                  mask;
+    uint64_t                  hits;
+    uint64_t                  misses;
+} JA4PlusTCPCache_t;
 
-            if (next == 1) // NOOP
-                continue;
+LOCAL JA4PlusTCPCache_t      tcpCaches[ARKIME_MAX_PACKET_THREADS];
+LOCAL int                    ja4plusTCPCacheSize;
+LOCAL int                    ja4plusTCPMaxPackets;
+LOCAL uint32_t               ja4plusTCPMaxUsec;
 
-            uint8_t size = 0;
-            BSB_IMPORT_u08(hbsb, size);
-            if (size < 2 || BSB_REMAINING(hbsb) < size - 2)
-                break;
-            if (next == 2)
-                BSB_IMPORT_u16(hbsb, mss);
-            else if (next == 3)
-                BSB_IMPORT_u08(hbsb, window_scale);
-            else
-                BSB_IMPORT_skip(hbsb, size - 2);
+/******************************************************************************/
+/* Returns the window_options_mss_scale string for the packet, either from
+ * the cache or formatted into buf. Not NUL terminated.
+ */
+LOCAL const char *ja4plus_tcp_fingerprint(int thread, const struct tcphdr *tcph, char *buf, int *len)
+{
+    JA4PlusTCPCache_t      *cache = ja4plusTCPCacheSize ? &tcpCaches[thread] : NULL;
+    JA4PlusTCPCacheEntry_t *entry = NULL;
+    uint8_t                 key[42];
+    int                     keyLen = 0;
+
+    if (cache) {
+        int optLen = MAX(tcph->th_off * 4 - 20, 0);
+        memcpy(key, &tcph->th_win, 2);
+        memcpy(key + 2, (const uint8_t *)tcph + 20, optLen);
+        keyLen = 2 + optLen;
+
+        uint64_t digest[2];
+        ja4plus_digest128(key, keyLen, digest);
+        entry = &cache->entries[digest[0] & cache->mask];
+
+        if (entry->keyLen == keyLen && memcmp(entry->key, key, keyLen) == 0) {
+            cache->hits++;
+            JA4PLUS_STAT(thread, JA4T, CACHE_HIT);
+            *len = entry->fpLen;
+            return entry->fp;
         }
-
-        BSB_EXPORT_rewind(obsb, 1); // remove last -
+        cache->misses++;
     }
 
-    if (mss == 0xffff) {
-        BSB_EXPORT_cstr(obsb, "_00");
-    } else {
-        BSB_EXPORT_sprintf(obsb, "_%d", mss);
+    JA4PlusTCPOptions_t opts;
+    ja4plus_tcp_options_parse(tcph, &opts);
+    *len = ja4plus_tcp_options_format(&opts, buf);
+
+    if (entry) {
+        entry->keyLen = keyLen;
+        memcpy(entry->key, key, keyLen);
+        entry->fpLen = *len;
+        memcpy(entry->fp, buf, *len);
+    }
+    return buf;
+}
+/******************************************************************************/
+LOCAL void ja4plus_ja4ts(ArkimeSession_t *session, JA4PlusData_t *data, const struct tcphdr *tcph)
+{
+    char obuf[250];
+    int  len;
+
+    const char *fp = ja4plus_tcp_fingerprint(session->thread, tcph, obuf, &len);
+    JA4PLUS_STAT(session->thread, JA4T, PRODUCED);
+    if (data->synAckTimesCnt <= 1) {
+        arkime_field_string_add(ja4tsField, session, fp, len, TRUE);
+        ja4plus_match(session, JA4PLUS_MATCH_JA4TS, fp, len);
+        return;
     }
 
-    if (window_scale == 0xff) {
-        BSB_EXPORT_cstr(obsb, "_00");
-    } else {
-        BSB_EXPORT_sprintf(obsb, "_%d", window_scale);
+    if (fp != obuf)
+        memcpy(obuf, fp, len);
+    char *p = obuf + len;
+
+    // Seconds between SYN/ACK retransmits
+    *(p++) = '_';
+    for (int i = 1; i < data->synAckTimesCnt; i++) {
+        p += ja4plus_fmt_u32(p, (data->synAckTimes[i] - data->synAckTimes[i - 1]) / 1000000);
+        *(p++) = '-';
     }
+    p--; // remove last -
+
+    arkime_field_string_add(ja4tsField, session, obuf, p - obuf, TRUE);
+    ja4plus_match(session, JA4PLUS_MATCH_JA4TS, obuf, p - obuf);
+}
+/******************************************************************************/
+LOCAL void ja4plus_ja4t(ArkimeSession_t *session, JA4PlusData_t UNUSED(*data), const struct tcphdr *tcph)
+{
+    char obuf[200];
+    int  len;
 
-    BSB_EXPORT_u08(obsb, 0);
-    arkime_field_string_add(ja4tField, session, obuf, -1, TRUE);
+    const char *fp = ja4plus_tcp_fingerprint(session->thread, tcph, obuf, &len);
+    JA4PLUS_STAT(session->thread, JA4T, PRODUCED);
+    arkime_field_string_add(ja4tField, session, fp, len, TRUE);
+    ja4plus_match(session, JA4PLUS_MATCH_JA4T, fp, len);
+}
+/******************************************************************************/
+/* latency_ttl_latency used by both JA4l and JA4ls */
+LOCAL int ja4plus_ja4l_format(char *out, uint32_t latency1, uint8_t ttl, uint32_t latency2)
+{
+    char *p = out;
+
+    p += ja4plus_fmt_u32(p, latency1);
+    *(p++) = '_';
+    p += ja4plus_fmt_u32(p, ttl);
+    *(p++) = '_';
+    p += ja4plus_fmt_u32(p, latency2);
+    return p - out;
 }
 /******************************************************************************/
+/* JA4l/JA4ls need the handshake and the first data in each direction, so only
+ * sessions that start with a SYN are tracked, and tracking stops once both are
+ * added or after ja4plusTCPMaxPackets packets or ja4plusTCPMaxSeconds.
+ */
 LOCAL uint32_t ja4plus_tcp_raw_packet(ArkimeSession_t *session, const uint8_t *UNUSED(d), int UNUSED(l), void *uw)
 {
-    JA4PlusData_t *ja4plus_data = session->pluginData[ja4plus_plugin_num];
-    JA4PlusTCP_t  *ja4plus_tcp;
-    if (!ja4plus_data) {
-        ja4plus_data = session->pluginData[ja4plus_plugin_num] = ARKIME_TYPE_ALLOC0 (JA4PlusData_t);
-        ja4plus_tcp = ja4plus_data->tcp = ARKIME_TYPE_ALLOC0 (JA4PlusTCP_t);
-    } else if (ja4plus_data->tcp) {
-        if (ja4plus_data->tcp == JA4PLUS_TCP_DONE)
+    ArkimePacket_t      *packet = (ArkimePacket_t *)uw;
+    const struct tcphdr *tcp = (struct tcphdr *)(packet->pkt + packet->payloadOffset);
+    JA4PlusData_t       *ja4plus_tcp = session->pluginData[ja4plus_plugin_num];
+
+    if (!ja4plus_tcp) {
+        if (!(tcp->th_flags & TH_SYN))
             return 0;
-        ja4plus_tcp = ja4plus_data->tcp;
-    } else {
-        ja4plus_tcp = ja4plus_data->tcp = ARKIME_TYPE_ALLOC0 (JA4PlusTCP_t);
+        ja4plus_tcp = session->pluginData[ja4plus_plugin_num] = ja4plus_data_alloc(session->thread);
     }
 
-    ArkimePacket_t      *packet = (ArkimePacket_t *)uw;
-    struct tcphdr       *tcphdr = (struct tcphdr *)(packet->pkt + packet->payloadOffset);
-    int                  len = packet->payloadLen - 4 * tcphdr->th_off;
+    switch (ja4plus_tcp->tcpState) {
+    case JA4PLUS_TCP_DONE:
+        return 0;
+    case JA4PLUS_TCP_START:
+        // Allocated by http for a session picked up mid stream
+        if (!(tcp->th_flags & TH_SYN)) {
+            JA4PLUS_STAT(session->thread, JA4L, SKIPPED);
+            ja4plus_tcp->tcpState = JA4PLUS_TCP_DONE;
+            return 0;
+        }
+        ja4plus_tcp->tcpState = JA4PLUS_TCP_TRACKING;
+        break;
+    }
+
+    uint32_t now = TIMESTAMP_TO_RUSEC(packet->ts);
+    if (ja4plus_tcp->tcpPackets >= ja4plusTCPMaxPackets || now > ja4plusTCPMaxUsec) {
+        if (ja4plusFingerprints & JA4PLUS_FP_JA4L)
+            JA4PLUS_STAT(session->thread, JA4L, SKIPPED);
+        ja4plus_tcp->tcpState = JA4PLUS_TCP_DONE;
+        return 0;
+    }
+    ja4plus_tcp->tcpPackets++;
+
+    int                  len = packet->payloadLen - 4 * tcp->th_off;
 
     const struct ip       *ip4 = (struct ip *)(packet->pkt + packet->ipOffset);
     const struct ip6_hdr  *ip6 = (struct ip6_hdr *)(packet->pkt + packet->ipOffset);
-    const struct tcphdr   *tcp = (struct tcphdr *)(packet->pkt + packet->payloadOffset);
 
     if (len == 0) {
         if (tcp->th_flags & TH_SYN) {
             if (tcp->th_flags & TH_ACK) {
                 if (ja4plus_tcp->synAckTimesCnt < JA4PLUS_SYN_ACK_COUNT) {
-                    ja4plus_tcp->synAckTimes[ja4plus_tcp->synAckTimesCnt] = TIMESTAMP_TO_RUSEC(packet->ts);
+                    ja4plus_tcp->synAckTimes[ja4plus_tcp->synAckTimesCnt] = now;
                     ja4plus_tcp->synAckTimesCnt++;
                 }
                 if (packet->v6) {
@@ -872,179 +2647,533 @@ LOCAL uint32_t ja4plus_tcp_raw_packet(ArkimeSession_t *session, const uint8_t *U
                 } else {
                     ja4plus_tcp->server_ttl = ip4->ip_ttl;
                 }
-                ja4plus_ja4ts(session, ja4plus_tcp, tcp);
+                if (ja4plusFingerprints & JA4PLUS_FP_JA4T)
+                    ja4plus_ja4ts(session, ja4plus_tcp, tcp);
             } else {
-                ja4plus_tcp->timestampA = TIMESTAMP_TO_RUSEC(packet->ts);
+                ja4plus_tcp->timestampA = now;
                 if (packet->v6) {
                     ja4plus_tcp->client_ttl = ip6->ip6_hops;
                 } else {
                     ja4plus_tcp->client_ttl = ip4->ip_ttl;
                 }
-                ja4plus_ja4t(session, ja4plus_tcp, tcp);
+                if (ja4plusFingerprints & JA4PLUS_FP_JA4T)
+                    ja4plus_ja4t(session, ja4plus_tcp, tcp);
             }
         } else {
             if ((tcp->th_flags & TH_ACK) && (ja4plus_tcp->timestampC == 0))
-                ja4plus_tcp->timestampC = TIMESTAMP_TO_RUSEC(packet->ts);
+                ja4plus_tcp->timestampC = now;
         }
+    } else if (ja4plus_tcp->synAckTimesCnt == 0 || !(ja4plusFingerprints & JA4PLUS_FP_JA4L)) {
+        // Data without a SYN/ACK or JA4l is off, no latency to measure
+        if (ja4plusFingerprints & JA4PLUS_FP_JA4L)
+            JA4PLUS_STAT(session->thread, JA4L, SKIPPED);
+        ja4plus_tcp->tcpState = JA4PLUS_TCP_DONE;
     } else {
         if (packet->direction == 0) {
             if (ja4plus_tcp->timestampD == 0) {
-                ja4plus_tcp->timestampD = TIMESTAMP_TO_RUSEC(packet->ts);
+                ja4plus_tcp->timestampD = now;
             } else if (ja4plus_tcp->timestampE != 0) {
-                uint32_t timestampF = TIMESTAMP_TO_RUSEC(packet->ts);
-
-                char ja4l[100];
-                snprintf(ja4l, sizeof(ja4l), "%u_%u_%u",
-                         (ja4plus_tcp->timestampC - ja4plus_tcp->synAckTimes[ja4plus_tcp->synAckTimesCnt - 1]) / 2,
-                         ja4plus_tcp->client_ttl,
-                         (timestampF - ja4plus_tcp->timestampE) / 2
-                        );
+                char ja4l[40];
+                int len = ja4plus_ja4l_format(ja4l,
+                                              (ja4plus_tcp->timestampC - ja4plus_tcp->synAckTimes[ja4plus_tcp->synAckTimesCnt - 1]) / 2,
+                                              ja4plus_tcp->client_ttl,
+                                              (now - ja4plus_tcp->timestampE) / 2);
 
-                arkime_field_string_add(ja4lField, session, ja4l, -1, TRUE);
+                JA4PLUS_STAT(session->thread, JA4L, PRODUCED);
+                arkime_field_string_add(ja4lField, session, ja4l, len, TRUE);
 
-                ARKIME_TYPE_FREE(JA4PlusTCP_t, ja4plus_data->tcp);
-                ja4plus_data->tcp = JA4PLUS_TCP_DONE;
+                ja4plus_tcp->tcpState = JA4PLUS_TCP_DONE;
             }
         } else {
             if (ja4plus_tcp->timestampE == 0) {
-                ja4plus_tcp->timestampE = TIMESTAMP_TO_RUSEC(packet->ts);
+                ja4plus_tcp->timestampE = now;
 
-                char ja4ls[100];
-                snprintf(ja4ls, sizeof(ja4ls), "%u_%u_%u",
-                         (ja4plus_tcp->synAckTimes[ja4plus_tcp->synAckTimesCnt - 1] - ja4plus_tcp->timestampA) / 2,
-                         ja4plus_tcp->server_ttl,
-                         (ja4plus_tcp->timestampE - ja4plus_tcp->timestampD) / 2
-                        );
+                char ja4ls[40];
+                int len = ja4plus_ja4l_format(ja4ls,
+                                              (ja4plus_tcp->synAckTimes[ja4plus_tcp->synAckTimesCnt - 1] - ja4plus_tcp->timestampA) / 2,
+                                              ja4plus_tcp->server_ttl,
+                                              (ja4plus_tcp->timestampE - ja4plus_tcp->timestampD) / 2);
 
-                arkime_field_string_add(ja4lsField, session, ja4ls, -1, TRUE);
+                JA4PLUS_STAT(session->thread, JA4L, PRODUCED);
+                arkime_field_string_add(ja4lsField, session, ja4ls, len, TRUE);
             }
         }
     }
     return 0;
 }
 /******************************************************************************/
+/* Add the text for the ja4h values collected since the last save */
+LOCAL void ja4plus_ja4h_flush(ArkimeSession_t *session)
+{
+    JA4PlusData_t *ja4plus_data = session->pluginData[ja4plus_plugin_num];
+    if (!ja4plus_data || !ja4plus_data->http)
+        return;
+
+    JA4PlusHTTPBufs_t *bufs = ja4plus_data->http;
+    char ja4h[52];
+    for (int i = 0; i < bufs->ja4hNum; i++) {
+        int len = ja4plus_fp_format(&bufs->ja4h[i], ja4h);
+        arkime_field_string_add(ja4hField, session, ja4h, len, TRUE);
+    }
+
+    // The fields start over after a save
+    bufs->ja4hNum = 0;
+    bufs->lastPending = 0;
+}
+/******************************************************************************/
+/* Called before the session is written, make sure nothing is left pending */
+void ja4plus_plugin_pre_save(ArkimeSession_t *session, int UNUSED(final))
+{
+    if (hashBatches[session->thread].num > 0)
+        ja4plus_ja4s_flush(session->thread);
+
+    if (ja4plusFingerprints & JA4PLUS_FP_JA4H)
+        ja4plus_ja4h_flush(session);
+}
+/******************************************************************************/
 void ja4plus_plugin_save(ArkimeSession_t *session, int final)
 {
     JA4PlusData_t *ja4plus_data = session->pluginData[ja4plus_plugin_num];
-    if (final && ja4plus_data) {
-        if (ja4plus_data->tcp && ja4plus_data->tcp != JA4PLUS_TCP_DONE)
-            ARKIME_TYPE_FREE(JA4PlusTCP_t, ja4plus_data->tcp);
 
-        if (ja4plus_data->http) {
-            JA4PlusHTTP_t *ja4_http = ja4plus_data->http;
+    if (hashBatches[session->thread].num > 0)
+        ja4plus_ja4s_flush(session->thread);
 
-            g_free(ja4_http->sorted_cookie_fields);
-            g_free(ja4_http->sorted_cookie_values);
-            g_string_free(ja4_http->header_value, TRUE);
-            g_string_free(ja4_http->header_fields, TRUE);
-            ARKIME_TYPE_FREE(JA4PlusHTTP_t, ja4_http);
+    if (ja4plusFingerprints & JA4PLUS_FP_JA4H)
+        ja4plus_ja4h_flush(session);
+
+    if (final && ja4plus_data) {
+        if (ja4plus_data->http)
+            ja4plus_http_free(session->thread, ja4plus_data->http);
+        if (ja4plus_data->ssh) {
+            if (ja4plus_data->ssh->packets[0] + ja4plus_data->ssh->packets[1] > 0)
+                ja4plus_ssh_add(session, ja4plus_data->ssh);
+            ARKIME_TYPE_FREE(JA4PlusSSH_t, ja4plus_data->ssh);
+            pools[session->thread].bytes -= sizeof(JA4PlusSSH_t);
         }
-        ARKIME_TYPE_FREE(JA4PlusData_t, ja4plus_data);
+        ja4plus_data_free(session->thread, ja4plus_data);
         session->pluginData[ja4plus_plugin_num] = NULL;
     }
 }
 /******************************************************************************/
+LOCAL inline uint64_t ja4plus_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+/******************************************************************************/
+LOCAL inline int ja4plus_latency_bucket(uint64_t ns)
+{
+    if (ns < (1 << JA4PLUS_LAT_SUB_BITS))
+        return ns;
+
+    int msb = 63 - __builtin_clzll(ns);
+    int bucket = ((msb - JA4PLUS_LAT_SUB_BITS + 1) << JA4PLUS_LAT_SUB_BITS) + ((ns >> (msb - JA4PLUS_LAT_SUB_BITS)) & ((1 << JA4PLUS_LAT_SUB_BITS) - 1));
+    return MIN(bucket, JA4PLUS_LAT_BUCKETS - 1);
+}
+/******************************************************************************/
+/* Largest value that goes in the bucket */
+LOCAL uint64_t ja4plus_latency_value(int bucket)
+{
+    if (bucket < (1 << JA4PLUS_LAT_SUB_BITS))
+        return bucket;
+
+    int group = bucket >> JA4PLUS_LAT_SUB_BITS;
+    int sub = bucket & ((1 << JA4PLUS_LAT_SUB_BITS) - 1);
+    int shift = group - 1;
+    return ((uint64_t)((1 << JA4PLUS_LAT_SUB_BITS) + sub + 1) << shift) - 1;
+}
+/******************************************************************************/
+/* Time one call in every ja4plusLatencySample */
+#define JA4PLUS_TIMED(thread, hook, call) \
+do { \
+    JA4PlusLatency_t *lat = &latencies[thread]; \
+    if (++lat->tick[hook] < ja4plusLatencySample) { \
+        call; \
+        break; \
+    } \
+    lat->tick[hook] = 0; \
+    uint64_t start = ja4plus_now_ns(); \
+    call; \
+    lat->buckets[hook][ja4plus_latency_bucket(ja4plus_now_ns() - start)]++; \
+} while (0)
+
+/******************************************************************************/
+LOCAL uint32_t ja4plus_tcp_raw_packet_timed(ArkimeSession_t *session, const uint8_t *data, int len, void *uw)
+{
+    uint32_t ret;
+    JA4PLUS_TIMED(session->thread, JA4PLUS_HOOK_TCP, ret = ja4plus_tcp_raw_packet(session, data, len, uw));
+    return ret;
+}
+/******************************************************************************/
+LOCAL uint32_t ja4plus_process_server_hello_timed(ArkimeSession_t *session, const uint8_t *data, int len, void *uw)
+{
+    uint32_t ret;
+    JA4PLUS_TIMED(session->thread, JA4PLUS_HOOK_SERVER, ret = ja4plus_process_server_hello(session, data, len, uw));
+    return ret;
+}
+/******************************************************************************/
+LOCAL uint32_t ja4plus_process_certificate_wInfo_timed(ArkimeSession_t *session, const uint8_t *data, int len, void *uw)
+{
+    uint32_t ret;
+    JA4PLUS_TIMED(session->thread, JA4PLUS_HOOK_CERT, ret = ja4plus_process_certificate_wInfo(session, data, len, uw));
+    return ret;
+}
+/******************************************************************************/
+LOCAL uint32_t ja4plus_ssh_ja4ssh_timed(ArkimeSession_t *session, const uint8_t *data, int len, void *uw)
+{
+    uint32_t ret;
+    JA4PLUS_TIMED(session->thread, JA4PLUS_HOOK_SSH, ret = ja4plus_ssh_ja4ssh(session, data, len, uw));
+    return ret;
+}
+/******************************************************************************/
+LOCAL void ja4plus_http_header_field_raw_timed(ArkimeSession_t *session, http_parser *hp, const char *at, size_t length)
+{
+    JA4PLUS_TIMED(session->thread, JA4PLUS_HOOK_HEADER, ja4plus_http_header_field_raw(session, hp, at, length));
+}
+/******************************************************************************/
+LOCAL void ja4plus_http_complete_timed(ArkimeSession_t *session, http_parser *parser)
+{
+    JA4PLUS_TIMED(session->thread, JA4PLUS_HOOK_COMPLETE, ja4plus_http_complete(session, parser));
+}
+/******************************************************************************/
+/* p50/p99/max of each callback since the last call, or since start for the
+ * final one at exit
+ */
+LOCAL void ja4plus_latency_log(gboolean sinceStart)
+{
+    LOCAL const char *names[JA4PLUS_HOOK_NUM] = {"tcp_raw_packet", "server_hello", "certificate", "header_field", "http_complete", "ja4ssh"};
+
+    for (int hook = 0; hook < JA4PLUS_HOOK_NUM; hook++) {
+        uint64_t buckets[JA4PLUS_LAT_BUCKETS];
+        uint64_t samples = 0;
+
+        for (int b = 0; b < JA4PLUS_LAT_BUCKETS; b++) {
+            uint64_t total = 0;
+            for (int t = 0; t < config.packetThreads; t++)
+                total += latencies[t].buckets[hook][b];
+            buckets[b] = sinceStart ? total : total - latencyLast[hook][b];
+            latencyLast[hook][b] = total;
+            samples += buckets[b];
+        }
+        if (samples == 0)
+            continue;
+
+        uint64_t p50 = 0, p99 = 0, max = 0, seen = 0;
+        for (int b = 0; b < JA4PLUS_LAT_BUCKETS; b++) {
+            if (!buckets[b])
+                continue;
+            seen += buckets[b];
+            if (!p50 && seen * 2 >= samples)
+                p50 = ja4plus_latency_value(b);
+            if (!p99 && seen * 100 >= samples * 99)
+                p99 = ja4plus_latency_value(b);
+            max = ja4plus_latency_value(b);
+        }
+        LOG("JA4+ %s samples: %" PRIu64 " p50: %" PRIu64 "ns p99: %" PRIu64 "ns max: %" PRIu64 "ns",
+            names[hook], samples, p50, p99, max);
+    }
+}
+/******************************************************************************/
+/* Sum the per thread counts, the packet threads keep writing while this reads
+ * so a total can be a little behind.
+ */
+LOCAL void ja4plus_stats_log()
+{
+    LOCAL const char *names[JA4PLUS_IDX_NUM] = {"JA4s", "JA4x", "JA4h", "JA4ssh", "JA4l", "JA4t"};
+
+    for (int fp = 0; fp < JA4PLUS_IDX_NUM; fp++) {
+        if (!(ja4plusFingerprints & (1 << fp)))
+            continue;
+
+        uint64_t total[JA4PLUS_STAT_NUM] = {0, 0, 0, 0, 0, 0, 0, 0};
+        for (int t = 0; t < config.packetThreads; t++) {
+            for (int i = 0; i < JA4PLUS_STAT_NUM; i++)
+                total[i] += stats[t].counts[fp][i];
+        }
+        LOG("%s produced: %" PRIu64 " failed: %" PRIu64 " truncated: %" PRIu64 " skipped: %" PRIu64 " cache hits: %" PRIu64 " matched: %" PRIu64 " stopped saving: %" PRIu64 " raw seen: %" PRIu64,
+            names[fp], total[JA4PLUS_STAT_PRODUCED], total[JA4PLUS_STAT_FAILED], total[JA4PLUS_STAT_TRUNCATED],
+            total[JA4PLUS_STAT_SKIPPED], total[JA4PLUS_STAT_CACHE_HIT], total[JA4PLUS_STAT_MATCHED],
+            total[JA4PLUS_STAT_STOPPED], total[JA4PLUS_STAT_RAW_SEEN]);
+    }
+}
+/******************************************************************************/
+LOCAL gboolean ja4plus_stats_timer(gpointer UNUSED(user_data))
+{
+    ja4plus_stats_log();
+    if (ja4plusLatencySample)
+        ja4plus_latency_log(FALSE);
+    return TRUE;
+}
+/******************************************************************************/
+void ja4plus_plugin_exit()
+{
+    ja4plus_stats_log();
+    if (ja4plusLatencySample)
+        ja4plus_latency_log(TRUE);
+
+    if (ja4plusCertCacheSize)
+        ja4plus_cache_log("JA4x", certCaches);
+
+    if (ja4plusJA4sCacheSize)
+        ja4plus_cache_log("JA4s", ja4sCaches);
+
+    if (ja4plusTCPCacheSize) {
+        uint64_t hits = 0, misses = 0;
+        for (int t = 0; t < config.packetThreads; t++) {
+            hits += tcpCaches[t].hits;
+            misses += tcpCaches[t].misses;
+        }
+        LOG("JA4t cache hits: %" PRIu64 " misses: %" PRIu64, hits, misses);
+    }
+
+    uint64_t bytes = 0, slabs = 0;
+    for (int t = 0; t < config.packetThreads; t++) {
+        bytes += pools[t].bytes;
+        slabs += pools[t].slabs;
+    }
+    LOG("JA4+ session bytes in use: %" PRIu64 " slab bytes: %" PRIu64, bytes, slabs * JA4PLUS_SLAB_COUNT * sizeof(JA4PlusData_t));
+}
+/******************************************************************************/
+/* Parse a ; or , separated list of fingerprint names into JA4PLUS_FP_ bits */
+LOCAL uint32_t ja4plus_config_fingerprints(const char *key, const char *d)
+{
+    LOCAL const struct {
+        const char *name;
+        uint32_t    bit;
+    } names[] = {
+        {"all",    JA4PLUS_FP_ALL},
+        {"ja4s",   JA4PLUS_FP_JA4S},
+        {"ja4x",   JA4PLUS_FP_JA4X},
+        {"ja4h",   JA4PLUS_FP_JA4H},
+        {"ja4ssh", JA4PLUS_FP_JA4SSH},
+        {"ja4l",   JA4PLUS_FP_JA4L},
+        {"ja4ls",  JA4PLUS_FP_JA4L},
+        {"ja4t",   JA4PLUS_FP_JA4T},
+        {"ja4ts",  JA4PLUS_FP_JA4T}
+    };
+
+    char *value = arkime_config_str(NULL, key, d);
+    if (!value)
+        return 0;
+
+    uint32_t mask = 0;
+    gchar **list = g_strsplit_set(value, ";,", 0);
+    for (int i = 0; list[i]; i++) {
+        const char *name = g_strstrip(list[i]);
+        if (!*name)
+            continue;
+
+        int n;
+        for (n = 0; n < (int)(sizeof(names) / sizeof(names[0])); n++) {
+            if (strcasecmp(name, names[n].name) == 0)
+                break;
+        }
+        if (n == (int)(sizeof(names) / sizeof(names[0])))
+            CONFIGEXIT("Unknown %s value '%s'", key, name);
+        mask |= names[n].bit;
+    }
+    g_strfreev(list);
+    g_free(value);
+    return mask;
+}
+/******************************************************************************/
 void arkime_plugin_init()
 {
     LOG("JA4+ plugin loaded");
 
     ja4plus_plugin_num = arkime_plugins_register("ja4plus", TRUE);
 
+    ja4plusFingerprints = ja4plus_config_fingerprints("ja4plusFingerprints", "all");
+    if (arkime_config_boolean(NULL, "ja4Raw", FALSE))
+        ja4plusRaw = ja4plus_config_fingerprints("ja4plusRaw", "all");
+    else
+        ja4plusRaw = ja4plus_config_fingerprints("ja4plusRaw", NULL);
+    ja4plusRaw &= ja4plusFingerprints & JA4PLUS_FP_RAW;
+
+    // The header list is only needed as text for ja4h_r
+    ja4plusStreamHeaders = !(ja4plusRaw & JA4PLUS_FP_JA4H);
+
+    ja4plusHashBatch = arkime_config_int(NULL, "ja4plusHashBatch", 0, 0, 256);
+    ja4plusCertCacheSize = arkime_config_int(NULL, "ja4plusCertCacheSize", 4096, 0, 1024 * 1024);
+    ja4plusJA4sCacheSize = arkime_config_int(NULL, "ja4plusJA4sCacheSize", 1024, 0, 1024 * 1024);
+    ja4plusTCPCacheSize = arkime_config_int(NULL, "ja4plusTCPCacheSize", 256, 0, 1024 * 1024);
+    ja4plusJA4hMax = arkime_config_int(NULL, "ja4plusJA4hMaxPerSession", 0, 0, 0xffff);
+
+    // The ssh parser only calls us every 200 packets
+    ja4plusSSHWindow = arkime_config_int(NULL, "ja4plusSSHWindow", JA4PLUS_SSH_CHUNK, JA4PLUS_SSH_CHUNK, 100 * JA4PLUS_SSH_CHUNK);
+    if (ja4plusSSHWindow % JA4PLUS_SSH_CHUNK) {
+        ja4plusSSHWindow -= ja4plusSSHWindow % JA4PLUS_SSH_CHUNK;
+        LOG("WARNING - ja4plusSSHWindow must be a multiple of %d, using %d", JA4PLUS_SSH_CHUNK, ja4plusSSHWindow);
+    }
+    ja4plusTCPMaxPackets = arkime_config_int(NULL, "ja4plusTCPMaxPackets", 50, 4, 255);
+    ja4plusTCPMaxUsec = arkime_config_int(NULL, "ja4plusTCPMaxSeconds", 60, 1, 3600) * 1000000U;
+    ja4plusStatsInterval = arkime_config_int(NULL, "ja4plusStatsInterval", 0, 0, 24 * 3600);
+    ja4plusLatencySample = arkime_config_int(NULL, "ja4plusLatencySample", 0, 0, 1000000);
+
+    // Nothing to allocate for fingerprints that are off
+    if (!(ja4plusFingerprints & JA4PLUS_FP_JA4S))
+        ja4plusHashBatch = ja4plusJA4sCacheSize = 0;
+    if (!(ja4plusFingerprints & JA4PLUS_FP_JA4X))
+        ja4plusCertCacheSize = 0;
+    if (!(ja4plusFingerprints & JA4PLUS_FP_JA4T))
+        ja4plusTCPCacheSize = 0;
+
     arkime_plugins_set_cb("ja4plus",
                           NULL,
                           NULL,
                           NULL,
-                          NULL,
+                          (ja4plusHashBatch || (ja4plusFingerprints & JA4PLUS_FP_JA4H)) ? ja4plus_plugin_pre_save : NULL,
                           ja4plus_plugin_save,
                           NULL,
-                          NULL,
+                          ja4plus_plugin_exit,
                           NULL);
 
-    arkime_plugins_set_http_ext_cb("ja4plus",
-                                   NULL,
-                                   NULL,
-                                   NULL,
-                                   ja4plus_http_header_field_raw,
-                                   ja4plus_http_header_value,
-                                   NULL,
-                                   NULL,
-                                   ja4plus_http_complete);
-
-    ja4Raw = arkime_config_boolean(NULL, "ja4Raw", FALSE);
-
-    arkime_parsers_add_named_func("tls_process_server_hello", ja4plus_process_server_hello);
-    arkime_parsers_add_named_func("tls_process_certificate_wInfo", ja4plus_process_certificate_wInfo);
-    arkime_parsers_add_named_func("ssh_counting200", ja4plus_ssh_ja4ssh);
-    arkime_parsers_add_named_func("tcp_raw_packet", ja4plus_tcp_raw_packet);
-
-    ja4sField = arkime_field_define("tls", "lotermfield",
-                                    "tls.ja4s", "JA4s", "tls.ja4s",
-                                    "SSL/TLS JA4s field",
-                                    ARKIME_FIELD_TYPE_STR_GHASH,  ARKIME_FIELD_FLAG_CNT,
-                                    (char *)NULL);
-
-    ja4sRawField = arkime_field_define("tls", "lotermfield",
-                                       "tls.ja4s_r", "JA4s_r", "tls.ja4s_r",
-                                       "SSL/TLS JA4s raw field",
-                                       ARKIME_FIELD_TYPE_STR_GHASH,  ARKIME_FIELD_FLAG_CNT,
-                                       (char *)NULL);
-
-
-    arkime_field_define("cert", "termfield",
-                        "cert.ja4x", "JA4x", "cert.ja4x",
-                        "JA4x",
-                        0, ARKIME_FIELD_FLAG_FAKE,
-                        (char *)NULL);
-
-    arkime_field_define("cert", "termfield",
-                        "cert.ja4x_r", "JA4x_r", "cert.ja4x_r",
-                        "JA4x_r",
-                        0, ARKIME_FIELD_FLAG_FAKE,
-                        (char *)NULL);
-
-    ja4sshField = arkime_field_define("ssh", "lotermfield",
-                                      "ssh.ja4ssh", "JA4ssh", "ssh.ja4ssh",
-                                      "SSH JA4ssh field",
-                                      ARKIME_FIELD_TYPE_STR_ARRAY,  ARKIME_FIELD_FLAG_CNT | ARKIME_FIELD_FLAG_DIFF_FROM_LAST,
-                                      (char *)NULL);
-
-    ja4lField = arkime_field_define("tcp", "lotermfield",
-                                    "tcp.ja4l", "JA4l", "tcp.ja4l",
-                                    "JA4 Latency Client field",
-                                    ARKIME_FIELD_TYPE_STR,  0,
-                                    (char *)NULL);
-
-    ja4lsField = arkime_field_define("tcp", "lotermfield",
-                                     "tcp.ja4ls", "JA4ls", "tcp.ja4ls",
-                                     "JA4 Latency Server field",
-                                     ARKIME_FIELD_TYPE_STR,  0,
-                                     (char *)NULL);
-
-    ja4tsField = arkime_field_define("tcp", "lotermfield",
-                                     "tcp.ja4ts", "JA4ts", "tcp.ja4ts",
-                                     "JA4 TCP Server field",
-                                     ARKIME_FIELD_TYPE_STR_GHASH,  ARKIME_FIELD_FLAG_CNT,
-                                     (char *)NULL);
-
-    ja4tField = arkime_field_define("tcp", "lotermfield",
-                                    "tcp.ja4t", "JA4t", "tcp.ja4t",
-                                    "JA4 TCP Client field",
-                                    ARKIME_FIELD_TYPE_STR_GHASH,  ARKIME_FIELD_FLAG_CNT,
-                                    (char *)NULL);
-
-    ja4hField = arkime_field_define("http", "lotermfield",
-                                    "http.ja4h", "JA4h", "http.ja4h",
-                                    "HTTP JA4h field",
-                                    ARKIME_FIELD_TYPE_STR_GHASH,  ARKIME_FIELD_FLAG_CNT,
-                                    (char *)NULL);
-
-    ja4hRawField = arkime_field_define("http", "lotermfield",
-                                       "http.ja4h_r", "JA4h_r", "http.ja4h_r",
-                                       "HTTP JA4h Raw field",
-                                       ARKIME_FIELD_TYPE_STR_GHASH,  ARKIME_FIELD_FLAG_CNT,
-                                       (char *)NULL);
+    if (ja4plusFingerprints & JA4PLUS_FP_JA4H) {
+        arkime_plugins_set_http_ext_cb("ja4plus",
+                                       NULL,
+                                       NULL,
+                                       NULL,
+                                       ja4plusLatencySample ? ja4plus_http_header_field_raw_timed : ja4plus_http_header_field_raw,
+                                       ja4plus_http_header_value,
+                                       NULL,
+                                       NULL,
+                                       ja4plusLatencySample ? ja4plus_http_complete_timed : ja4plus_http_complete);
+
+        // First two characters of each method lower cased, used as the ja4h prefix
+        for (int m = 0; m < 256; m++) {
+            const char *str = http_method_str(m);
+            for (int i = 0; i < 2 && str[i]; i++) {
+                ja4plus_http_methods[m][i] = g_ascii_tolower(str[i]);
+            }
+        }
+    }
+
+    if (ja4plusFingerprints & JA4PLUS_FP_JA4S)
+        arkime_parsers_add_named_func("tls_process_server_hello", ja4plusLatencySample ? ja4plus_process_server_hello_timed : ja4plus_process_server_hello);
+    if (ja4plusFingerprints & JA4PLUS_FP_JA4X)
+        arkime_parsers_add_named_func("tls_process_certificate_wInfo", ja4plusLatencySample ? ja4plus_process_certificate_wInfo_timed : ja4plus_process_certificate_wInfo);
+    if (ja4plusFingerprints & JA4PLUS_FP_JA4SSH)
+        arkime_parsers_add_named_func("ssh_counting200", ja4plusLatencySample ? ja4plus_ssh_ja4ssh_timed : ja4plus_ssh_ja4ssh);
+    if (ja4plusFingerprints & (JA4PLUS_FP_JA4L | JA4PLUS_FP_JA4T))
+        arkime_parsers_add_named_func("tcp_raw_packet", ja4plusLatencySample ? ja4plus_tcp_raw_packet_timed : ja4plus_tcp_raw_packet);
+
+    if (ja4plusFingerprints & JA4PLUS_FP_JA4S) {
+        ja4sField = arkime_field_define("tls", "lotermfield",
+                                        "tls.ja4s", "JA4s", "tls.ja4s",
+                                        "SSL/TLS JA4s field",
+                                        ARKIME_FIELD_TYPE_STR_GHASH,  ARKIME_FIELD_FLAG_CNT,
+                                        (char *)NULL);
+
+        ja4sRawField = arkime_field_define("tls", "lotermfield",
+                                           "tls.ja4s_r", "JA4s_r", "tls.ja4s_r",
+                                           "SSL/TLS JA4s raw field",
+                                           ARKIME_FIELD_TYPE_STR_GHASH,  ARKIME_FIELD_FLAG_CNT,
+                                           (char *)NULL);
+    }
+
+    if (ja4plusFingerprints & JA4PLUS_FP_JA4X) {
+        arkime_field_define("cert", "termfield",
+                            "cert.ja4x", "JA4x", "cert.ja4x",
+                            "JA4x",
+                            0, ARKIME_FIELD_FLAG_FAKE,
+                            (char *)NULL);
+
+        arkime_field_define("cert", "termfield",
+                            "cert.ja4x_r", "JA4x_r", "cert.ja4x_r",
+                            "JA4x_r",
+                            0, ARKIME_FIELD_FLAG_FAKE,
+                            (char *)NULL);
+    }
+
+    if (ja4plusFingerprints & JA4PLUS_FP_JA4SSH) {
+        ja4sshField = arkime_field_define("ssh", "lotermfield",
+                                          "ssh.ja4ssh", "JA4ssh", "ssh.ja4ssh",
+                                          "SSH JA4ssh field",
+                                          ARKIME_FIELD_TYPE_STR_ARRAY,  ARKIME_FIELD_FLAG_CNT | ARKIME_FIELD_FLAG_DIFF_FROM_LAST,
+                                          (char *)NULL);
+    }
+
+    if (ja4plusFingerprints & JA4PLUS_FP_JA4L) {
+        ja4lField = arkime_field_define("tcp", "lotermfield",
+                                        "tcp.ja4l", "JA4l", "tcp.ja4l",
+                                        "JA4 Latency Client field",
+                                        ARKIME_FIELD_TYPE_STR,  0,
+                                        (char *)NULL);
+
+        ja4lsField = arkime_field_define("tcp", "lotermfield",
+                                         "tcp.ja4ls", "JA4ls", "tcp.ja4ls",
+                                         "JA4 Latency Server field",
+                                         ARKIME_FIELD_TYPE_STR,  0,
+                                         (char *)NULL);
+    }
+
+    if (ja4plusFingerprints & JA4PLUS_FP_JA4T) {
+        ja4tField = arkime_field_define("tcp", "lotermfield",
+                                        "tcp.ja4t", "JA4t", "tcp.ja4t",
+                                        "JA4 TCP Client field",
+                                        ARKIME_FIELD_TYPE_STR_GHASH,  ARKIME_FIELD_FLAG_CNT,
+                                        (char *)NULL);
+
+        ja4tsField = arkime_field_define("tcp", "lotermfield",
+                                         "tcp.ja4ts", "JA4ts", "tcp.ja4ts",
+                                         "JA4 TCP Server field",
+                                         ARKIME_FIELD_TYPE_STR_GHASH,  ARKIME_FIELD_FLAG_CNT,
+                                         (char *)NULL);
+    }
+
+    if (ja4plusFingerprints & JA4PLUS_FP_JA4H) {
+        ja4hField = arkime_field_define("http", "lotermfield",
+                                        "http.ja4h", "JA4h", "http.ja4h",
+                                        "HTTP JA4h field",
+                                        ARKIME_FIELD_TYPE_STR_GHASH,  ARKIME_FIELD_FLAG_CNT,
+                                        (char *)NULL);
+
+        ja4hRawField = arkime_field_define("http", "lotermfield",
+                                           "http.ja4h_r", "JA4h_r", "http.ja4h_r",
+                                           "HTTP JA4h Raw field",
+                                           ARKIME_FIELD_TYPE_STR_GHASH,  ARKIME_FIELD_FLAG_CNT,
+                                           (char *)NULL);
+    }
+
+    ja4plus_hash12_init();
+
+    ja4plusDigestSeed = (uint64_t)g_random_int() << 32 | g_random_int();
+
+    if (ja4plusStatsInterval)
+        g_timeout_add_seconds(ja4plusStatsInterval, ja4plus_stats_timer, NULL);
+
+    ja4plus_match_init();
+    ja4plus_raw_seen_init();
+
     int t;
     for (t = 0; t < config.packetThreads; t++) {
-        checksums256[t] = g_checksum_new(G_CHECKSUM_SHA256);
+        if (ja4plusHashBatch)
+            hashBatches[t].pending = g_malloc(ja4plusHashBatch * sizeof(JA4PlusPendingJA4S_t));
+
+        if (ja4plusCertCacheSize)
+            ja4plus_cache_init(&certCaches[t], ja4plusCertCacheSize);
+
+        if (ja4plusJA4sCacheSize)
+            ja4plus_cache_init(&ja4sCaches[t], ja4plusJA4sCacheSize);
+
+        if (ja4plusTCPCacheSize) {
+            uint32_t size = 1;
+            while (size < (uint32_t)ja4plusTCPCacheSize)
+                size <<= 1;
+            tcpCaches[t].entries = g_malloc0(size * sizeof(JA4PlusTCPCacheEntry_t));
+            tcpCaches[t].mask = size - 1;
+        }
+
+        if ((ja4plusFingerprints & JA4PLUS_FP_JA4SSH) && ja4plusSSHWindow == JA4PLUS_SSH_CHUNK)
+            sshScratch[t] = g_malloc0(sizeof(JA4PlusSSH_t));
+
+        if (ja4plusFingerprints & JA4PLUS_FP_JA4H) {
+            cookieArenas[t].size = 64;
+            cookieArenas[t].cookies = g_malloc(cookieArenas[t].size * sizeof(JA4PlusCookie_t));
+            cookieArenas[t].tmp = g_malloc(cookieArenas[t].size / 2 * sizeof(JA4PlusCookie_t));
+            cookieArenas[t].fields = g_string_sized_new(1024);
+            cookieArenas[t].values = g_string_sized_new(4096);
+        }
     }
 }
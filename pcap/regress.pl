@@ -0,0 +1,249 @@
+#!/usr/bin/perl
+# regress.pl -- replay the pcaps that have JA4+ output through capture
+#
+# Runs each pcap through capture with the plugin loaded several times,
+# checks only the ja4* fields against the .test files and records
+# packets/sec and the plugin's share of the CPU time in a JSON report.
+#
+# The plugin share is measured by also running each pcap without the
+# plugin, it is (cpu with plugin - cpu without) / cpu with plugin.
+#
+# Usage: pcap/regress.pl [--arkime ~/arkime] [--runs 5] [--report file]
+#                        [--compare old-report] [--threshold 10]
+#                        [--extra "-o plugins=ja4plus.so"] [pcaps...]
+#
+# Exits non zero if any ja4* field differs from the .test file or, with
+# --compare, if packets/sec dropped by more than --threshold percent.
+
+use strict;
+use warnings;
+use Getopt::Long;
+use JSON::PP;
+use Time::HiRes qw(time);
+use File::Basename;
+use Cwd qw(abs_path);
+
+my $arkime = "$ENV{HOME}/arkime";
+my $runs = 5;
+my $report = "regress.json";
+my $compare;
+my $threshold = 10;
+my $extra = "-o plugins=ja4plus.so";
+
+GetOptions("arkime=s"    => \$arkime,
+           "runs=i"      => \$runs,
+           "report=s"    => \$report,
+           "compare=s"   => \$compare,
+           "threshold=f" => \$threshold,
+           "extra=s"     => \$extra) or die "Bad options, see the top of $0\n";
+
+# capture is run from $arkime/tests so a relative path won't resolve there
+$arkime = abs_path($arkime) // $arkime;
+
+my $pcapDir = dirname(abs_path($0));
+my $capture = "$arkime/capture/capture";
+die "No capture at $capture, use --arkime\n" if (! -x $capture);
+
+my @pcaps = @ARGV ? map { abs_path($_) } @ARGV : defaultPcaps();
+die "No pcaps found, run make setup first\n" if (!@pcaps);
+
+my $json = JSON::PP->new->canonical->relaxed;
+
+################################################################################
+# Every pcap with a .test file that has a ja4 field
+sub defaultPcaps {
+    my @list;
+    foreach my $test (sort glob("$pcapDir/*.test")) {
+        (my $pcap = $test) =~ s/\.test$/.pcap/;
+        next if (! -e $pcap);
+        open(my $fh, "<", $test) or next;
+        my $data = do { local $/; <$fh> };
+        close($fh);
+        push(@list, $pcap) if ($data =~ /"ja4/);
+    }
+    return @list;
+}
+
+################################################################################
+# The ja4* fields of each session, as sorted canonical JSON strings.
+# Array order isn't checked since the hash fields have no order.
+sub ja4Fields {
+    my ($sessions) = @_;
+    my @out;
+
+    foreach my $session (@{$sessions}) {
+        my %fields;
+        collect($session->{body}, "", \%fields);
+        push(@out, $json->encode(\%fields)) if (%fields);
+    }
+    return [sort @out];
+}
+
+sub collect {
+    my ($obj, $prefix, $fields) = @_;
+    return if (ref($obj) ne "HASH");
+
+    foreach my $key (keys %{$obj}) {
+        my $value = $obj->{$key};
+        if ($key =~ /^ja4/) {
+            $value = [sort @{$value}] if (ref($value) eq "ARRAY");
+            $fields->{"$prefix$key"} = $value;
+        } elsif (ref($value) eq "HASH") {
+            collect($value, "$prefix$key.", $fields);
+        } elsif (ref($value) eq "ARRAY") {
+            # Arrays of objects like cert, each element's fields are gathered
+            # under key[]. and sorted like the other multi value fields
+            my %elements;
+            foreach my $element (@{$value}) {
+                my %one;
+                collect($element, "", \%one);
+                foreach my $name (keys %one) {
+                    push(@{$elements{$name}}, ref($one{$name}) eq "ARRAY" ? @{$one{$name}} : $one{$name});
+                }
+            }
+            foreach my $name (keys %elements) {
+                $fields->{"$prefix$key\[\].$name"} = [sort @{$elements{$name}}];
+            }
+        }
+    }
+}
+
+################################################################################
+# Run capture once, returns the sessions and wall seconds
+sub runCapture {
+    my ($pcap, $args) = @_;
+
+    # No shell, so paths with spaces or quotes are passed through as is. The
+    # sessions are written to stderr and everything else is thrown away.
+    my @cmd = ($capture, "-c", "config.test.ini", "-n", "test", "--tests", "-r", $pcap, split(" ", $args));
+
+    my $start = time();
+    my $pid = open(my $fh, "-|") // die "Can't fork: $!\n";
+    if ($pid == 0) {
+        chdir("$arkime/tests") or die "Can't cd to $arkime/tests: $!\n";
+        open(STDERR, ">&", \*STDOUT) or die "Can't dup stdout: $!\n";
+        open(STDOUT, ">", "/dev/null") or die "Can't open /dev/null: $!\n";
+        exec {$cmd[0]} @cmd or die "Can't run $capture: $!\n";
+    }
+    my $output = do { local $/; <$fh> };
+    close($fh);
+    my $wall = time() - $start;
+
+    my $pos = index($output, '"sessions3"');
+    die "No sessions from capture for $pcap\n" if ($pos == -1);
+    $pos = rindex($output, "{", $pos);
+    my $result = $json->decode(substr($output, $pos));
+
+    return ($result->{sessions3}, $wall);
+}
+
+################################################################################
+# CPU seconds used by finished children, only clock tick resolution so
+# it is measured over all the runs of a pcap
+sub childCpu {
+    my @t = times();
+    return $t[2] + $t[3];
+}
+
+################################################################################
+sub packets {
+    my ($sessions) = @_;
+    my $packets = 0;
+    foreach my $session (@{$sessions}) {
+        $packets += $session->{body}->{network}->{packets} // 0;
+    }
+    return $packets;
+}
+
+################################################################################
+my @files;
+my %total = (packets => 0, wallSeconds => 0, cpuSeconds => 0, baselineCpuSeconds => 0, drift => 0);
+
+foreach my $pcap (@pcaps) {
+    (my $test = $pcap) =~ s/\.pcap$/.test/;
+    open(my $fh, "<", $test) or die "Can't open $test: $!\n";
+    my $expected = ja4Fields($json->decode(do { local $/; <$fh> })->{sessions3});
+    close($fh);
+
+    my %file = (pcap => basename($pcap), packets => 0, wallSeconds => 0, cpuSeconds => 0, baselineCpuSeconds => 0);
+    my %drift;
+
+    my $cpu = childCpu();
+    for (my $r = 0; $r < $runs; $r++) {
+        my ($sessions, $wall) = runCapture($pcap, $extra);
+        $file{packets} += packets($sessions);
+        $file{wallSeconds} += $wall;
+
+        my $got = ja4Fields($sessions);
+        my %count;
+        $count{$_}++ foreach (@{$expected});
+        $count{$_}-- foreach (@{$got});
+        foreach my $fields (keys %count) {
+            next if ($count{$fields} == 0);
+            $drift{($count{$fields} > 0 ? "missing " : "extra ") . $fields} = 1;
+        }
+    }
+    $file{cpuSeconds} = childCpu() - $cpu;
+
+    $cpu = childCpu();
+    for (my $r = 0; $r < $runs; $r++) {
+        runCapture($pcap, "");
+    }
+    $file{baselineCpuSeconds} = childCpu() - $cpu;
+
+    $file{drift} = [sort keys %drift];
+    $file{packetsPerSec} = $file{wallSeconds} > 0 ? $file{packets} / $file{wallSeconds} : 0;
+    $file{pluginCpuShare} = $file{cpuSeconds} > 0 ? ($file{cpuSeconds} - $file{baselineCpuSeconds}) / $file{cpuSeconds} : 0;
+    push(@files, \%file);
+
+    $total{$_} += $file{$_} foreach ("packets", "wallSeconds", "cpuSeconds", "baselineCpuSeconds");
+    $total{drift} += scalar @{$file{drift}};
+
+    printf("%-50s %10.0f pkts/s %6.1f%% plugin cpu%s\n", $file{pcap}, $file{packetsPerSec}, $file{pluginCpuShare} * 100,
+           @{$file{drift}} ? " DRIFT" : "");
+    print "    $_\n" foreach (@{$file{drift}});
+}
+
+$total{packetsPerSec} = $total{wallSeconds} > 0 ? $total{packets} / $total{wallSeconds} : 0;
+$total{pluginCpuShare} = $total{cpuSeconds} > 0 ? ($total{cpuSeconds} - $total{baselineCpuSeconds}) / $total{cpuSeconds} : 0;
+printf("TOTAL %d pcaps %.0f pkts/s %.1f%% plugin cpu %d drift\n", scalar @files, $total{packetsPerSec}, $total{pluginCpuShare} * 100, $total{drift});
+
+my $failed = $total{drift} > 0;
+
+################################################################################
+# Compare packets/sec per pcap against an older report
+my @regressions;
+if ($compare) {
+    open(my $fh, "<", $compare) or die "Can't open $compare: $!\n";
+    my $old = $json->decode(do { local $/; <$fh> });
+    close($fh);
+
+    my %oldFiles = map { $_->{pcap} => $_ } @{$old->{files}};
+    foreach my $file (@files, {pcap => "TOTAL", %total}) {
+        my $oldFile = $file->{pcap} eq "TOTAL" ? $old->{total} : $oldFiles{$file->{pcap}};
+        next if (!$oldFile || !$oldFile->{packetsPerSec});
+
+        my $change = ($file->{packetsPerSec} - $oldFile->{packetsPerSec}) * 100 / $oldFile->{packetsPerSec};
+        if ($change < -$threshold) {
+            push(@regressions, {pcap => $file->{pcap}, oldPacketsPerSec => $oldFile->{packetsPerSec},
+                                packetsPerSec => $file->{packetsPerSec}, changePercent => $change});
+            printf("REGRESSION %-39s %10.0f -> %10.0f pkts/s (%.1f%%)\n", $file->{pcap}, $oldFile->{packetsPerSec}, $file->{packetsPerSec}, $change);
+        }
+    }
+    $failed ||= @regressions > 0;
+}
+
+################################################################################
+open(my $out, ">", $report) or die "Can't write $report: $!\n";
+print $out JSON::PP->new->canonical->pretty->encode({
+    date        => int(time()),
+    arkime      => $arkime,
+    extra       => $extra,
+    runs        => $runs,
+    total       => \%total,
+    files       => \@files,
+    regressions => \@regressions,
+});
+close($out);
+
+exit($failed ? 1 : 0);
@@ -0,0 +1,208 @@
+/* api.c  -- the capture API ja4plus.c calls, for ja4plus-pcap
+ *
+ * Fields are added to the ja4plus-pcap session and written out when it
+ * ends, config comes from -o key=value.
+ *
+ * SPDX-License-Identifier: FoxIO License 1.1
+ */
+
+#include "ja4plus-pcap.h"
+
+ArkimeConfig_t               config;
+uint8_t                      arkime_char_to_hexstr[256][3];
+
+ArkimePluginSaveFunc         jpPreSave;
+ArkimePluginSaveFunc         jpSave;
+ArkimePluginExitFunc         jpExit;
+ArkimePluginHttpDataFunc     jpHeaderFieldRaw;
+ArkimePluginHttpDataFunc     jpHeaderValue;
+ArkimePluginHttpFunc         jpMessageComplete;
+
+LOCAL const char            *fieldNames[JP_MAX_FIELDS];
+LOCAL int                    fieldNum = 1;
+
+LOCAL const char            *namedNames[JP_MAX_FIELDS];
+LOCAL ArkimeParserNamedFunc  namedFuncs[JP_MAX_FIELDS];
+LOCAL int                    namedNum;
+
+LOCAL char                  *configKeys[JP_MAX_FIELDS];
+LOCAL char                  *configValues[JP_MAX_FIELDS];
+LOCAL int                    configNum;
+
+LOCAL int                    tagsField = -1;
+
+/******************************************************************************/
+int arkime_plugins_register(const char *UNUSED(name), gboolean UNUSED(storeData))
+{
+    return 0;
+}
+/******************************************************************************/
+void arkime_plugins_set_cb(const char *UNUSED(name),
+                           ArkimePluginIpFunc UNUSED(ipFunc),
+                           ArkimePluginUdpFunc UNUSED(udpFunc),
+                           ArkimePluginTcpFunc UNUSED(tcpFunc),
+                           ArkimePluginSaveFunc preSaveFunc,
+                           ArkimePluginSaveFunc saveFunc,
+                           ArkimePluginNewFunc UNUSED(newFunc),
+                           ArkimePluginExitFunc exitFunc,
+                           ArkimePluginReloadFunc UNUSED(reloadFunc))
+{
+    jpPreSave = preSaveFunc;
+    jpSave = saveFunc;
+    jpExit = exitFunc;
+}
+/******************************************************************************/
+void arkime_plugins_set_http_ext_cb(const char *UNUSED(name),
+                                    ArkimePluginHttpFunc UNUSED(onMessageBegin),
+                                    ArkimePluginHttpDataFunc UNUSED(onUrl),
+                                    ArkimePluginHttpDataFunc UNUSED(onHeaderField),
+                                    ArkimePluginHttpDataFunc onHeaderFieldRaw,
+                                    ArkimePluginHttpDataFunc onHeaderValue,
+                                    ArkimePluginHttpFunc UNUSED(onHeadersComplete),
+                                    ArkimePluginHttpDataFunc UNUSED(onBody),
+                                    ArkimePluginHttpFunc onMessageComplete)
+{
+    jpHeaderFieldRaw = onHeaderFieldRaw;
+    jpHeaderValue = onHeaderValue;
+    jpMessageComplete = onMessageComplete;
+}
+/******************************************************************************/
+void arkime_parsers_add_named_func(const char *name, ArkimeParserNamedFunc func)
+{
+    if (namedNum == JP_MAX_FIELDS)
+        LOGEXIT("Too many named funcs");
+    namedNames[namedNum] = name;
+    namedFuncs[namedNum] = func;
+    namedNum++;
+}
+/******************************************************************************/
+ArkimeParserNamedFunc jp_named_func(const char *name)
+{
+    for (int i = 0; i < namedNum; i++) {
+        if (strcmp(namedNames[i], name) == 0)
+            return namedFuncs[i];
+    }
+    return NULL;
+}
+/******************************************************************************/
+void jp_config_set(const char *keyValue)
+{
+    const char *equal = strchr(keyValue, '=');
+    if (!equal || configNum == JP_MAX_FIELDS)
+        LOGEXIT("Bad -o %s, expected key=value", keyValue);
+
+    configKeys[configNum] = g_strndup(keyValue, equal - keyValue);
+    configValues[configNum] = g_strdup(equal + 1);
+    configNum++;
+}
+/******************************************************************************/
+LOCAL const char *jp_config_get(const char *key)
+{
+    for (int i = configNum - 1; i >= 0; i--) {
+        if (strcmp(configKeys[i], key) == 0)
+            return configValues[i];
+    }
+    return NULL;
+}
+/******************************************************************************/
+gboolean arkime_config_boolean(GKeyFile *UNUSED(keyfile), const char *key, gboolean d)
+{
+    const char *value = jp_config_get(key);
+    if (!value)
+        return d;
+    return strcmp(value, "true") == 0 || strcmp(value, "1") == 0;
+}
+/******************************************************************************/
+int arkime_config_int(GKeyFile *UNUSED(keyfile), const char *key, int d, int min, int max)
+{
+    const char *value = jp_config_get(key);
+    if (!value)
+        return d;
+    return MIN(MAX(atoi(value), min), max);
+}
+/******************************************************************************/
+char *arkime_config_str(GKeyFile *UNUSED(keyfile), const char *key, const char *d)
+{
+    const char *value = jp_config_get(key);
+    if (!value)
+        value = d;
+    return g_strdup(value);
+}
+/******************************************************************************/
+/* Output uses the field name without the group, tls.ja4s is ja4s */
+int arkime_field_define(const char *UNUSED(group), const char *UNUSED(kind), const char *expression, const char *UNUSED(friendlyName), const char *UNUSED(dbField), const char *UNUSED(help), int UNUSED(type), int UNUSED(flags), ...)
+{
+    if (fieldNum == JP_MAX_FIELDS)
+        LOGEXIT("Too many fields");
+
+    const char *dot = strchr(expression, '.');
+    fieldNames[fieldNum] = dot ? dot + 1 : expression;
+    return fieldNum++;
+}
+/******************************************************************************/
+int jp_field_count()
+{
+    return fieldNum;
+}
+/******************************************************************************/
+const char *jp_field_name(int pos)
+{
+    return fieldNames[pos];
+}
+/******************************************************************************/
+gboolean arkime_field_string_add(int pos, ArkimeSession_t *session, const char *string, int len, gboolean copy)
+{
+    if (len == -1)
+        len = strlen(string);
+
+    jp_session_field_add(session, pos, string, len);
+
+    if (!copy)
+        g_free((char *)string);
+    return TRUE;
+}
+/******************************************************************************/
+/* ja4plus-pcap passes the session as the cert info */
+void arkime_field_certsinfo_update_extra(void *cert, char *key, char *value)
+{
+    for (int pos = 1; pos < fieldNum; pos++) {
+        if (strcmp(fieldNames[pos], key) == 0) {
+            jp_session_field_add(cert, pos, value, strlen(value));
+            break;
+        }
+    }
+
+    g_free(key);
+    g_free(value);
+}
+/******************************************************************************/
+void arkime_session_add_tag(ArkimeSession_t *session, const char *tag)
+{
+    if (tagsField != -1)
+        jp_session_field_add(session, tagsField, tag, strlen(tag));
+}
+/******************************************************************************/
+/* Workers may still be using it and there is no main loop to free it later,
+ * it's kept until exit.
+ */
+void arkime_free_later(void *UNUSED(ptr), GDestroyNotify UNUSED(cb))
+{
+}
+/******************************************************************************/
+/* Only have a tags column when something can add tags */
+void jp_api_tags_init()
+{
+    if (jp_config_get("ja4plusMatchDB"))
+        tagsField = arkime_field_define("general", "termfield", "tags", "Tags", "tags", "Tags", 0, 0, (char *)NULL);
+}
+/******************************************************************************/
+void jp_api_init()
+{
+    LOCAL const char hex[] = "0123456789abcdef";
+
+    for (int i = 0; i < 256; i++) {
+        arkime_char_to_hexstr[i][0] = hex[i >> 4];
+        arkime_char_to_hexstr[i][1] = hex[i & 0xf];
+        arkime_char_to_hexstr[i][2] = 0;
+    }
+}
@@ -0,0 +1,306 @@
+/* arkime.h  -- minimal stand in for capture/arkime.h
+ *
+ * Only declares what ja4plus.c uses, with the same names and signatures
+ * as capture so the plugin source compiles unchanged outside of capture.
+ * bench/ and ja4plus-pcap each implement these for their own needs.
+ *
+ * SPDX-License-Identifier: FoxIO License 1.1
+ */
+
+#ifndef ARKIME_STANDALONE_ARKIME_H
+#define ARKIME_STANDALONE_ARKIME_H
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <glib.h>
+
+#define LOCAL static
+#define UNUSED(x) x __attribute((unused))
+
+#define ARKIME_MAX_PACKET_THREADS 24
+
+#define LOG(...) do { \
+    fprintf(stderr, "%s:%d ", __FUNCTION__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); \
+    fprintf(stderr, "\n"); \
+} while(0)
+
+#define LOGEXIT(...) do { LOG(__VA_ARGS__); exit(1); } while(0)
+
+#define CONFIGEXIT(...) do { LOG("CONFIG ERROR - " __VA_ARGS__); exit(1); } while(0)
+
+#define ARKIME_TYPE_ALLOC0(type) (type *)g_malloc0(sizeof(type))
+#define ARKIME_TYPE_FREE(type,mem) g_free(mem)
+
+#define ARKIME_LOCK_INIT(var) pthread_mutex_init(&var##_mutex, NULL)
+#define ARKIME_LOCK(var) pthread_mutex_lock(&var##_mutex)
+#define ARKIME_UNLOCK(var) pthread_mutex_unlock(&var##_mutex)
+
+/******************************************************************************/
+/*
+ * Byte stream buffer, same semantics as capture/bsb.h
+ */
+typedef struct {
+    unsigned char *buf;
+    unsigned char *ptr;
+    unsigned char *end;
+} BSB;
+
+#define BSB_INIT(b, buffer, size) \
+do { \
+    (b).buf = (unsigned char*)buffer; \
+    (b).ptr = (unsigned char*)buffer; \
+    int s = (int)size; \
+    if ((buffer == NULL) || (s < 0)) \
+        (b).end = 0; \
+    else \
+        (b).end = (unsigned char*)buffer + size; \
+} while (0)
+
+#define BSB_SET_ERROR(b) ((b).end = NULL)
+#define BSB_IS_ERROR(b) ((b).end == NULL)
+#define BSB_LENGTH(b) ((b).ptr - (b).buf)
+#define BSB_REMAINING(b) ((b).end?(b).end-(b).ptr:0)
+#define BSB_WORK_PTR(b) ((b).ptr)
+
+#define BSB_EXPORT_u08(b, x) \
+do { \
+    if ((b).ptr + 1 <= (b).end) { \
+        *(((b).ptr)++) = (unsigned char)x; \
+    } else \
+        BSB_SET_ERROR(b); \
+} while (0)
+
+#define BSB_EXPORT_ptr(b, x, size) \
+do { \
+    if ((x || size == 0) && \
+        (b).ptr + size <= (b).end && \
+        (b).ptr + size >= (b).buf) { \
+        memcpy((b).ptr, x, size); \
+        (b).ptr += size; \
+    } else \
+        BSB_SET_ERROR(b); \
+} while (0)
+
+#define BSB_EXPORT_rewind(b, size) \
+do { \
+    if ((b).ptr - size >= (b).buf && \
+        (b).ptr - size < (b).ptr) { \
+        (b).ptr -= size; \
+    } else \
+        BSB_SET_ERROR(b); \
+} while (0)
+
+#define BSB_IMPORT_u08(b, x) \
+do { \
+    if ((b).ptr + 1 <= (b).end) { \
+        x = *(((b).ptr)++); \
+    } else \
+        BSB_SET_ERROR(b); \
+} while (0)
+
+#define BSB_IMPORT_u16(b, x) \
+do { \
+    if ((b).ptr + 2 <= (b).end) { \
+        x = ((uint16_t)((b).ptr)[0]) << 8 | \
+            ((uint16_t)((b).ptr)[1]); \
+        (b).ptr += 2; \
+    } else \
+        BSB_SET_ERROR(b); \
+} while (0)
+
+#define BSB_IMPORT_ptr(b, x, size) \
+do { \
+    if ((b).ptr + size <= (b).end && \
+        (b).ptr + size >= (b).buf) { \
+        (x) = (b).ptr; \
+        (b).ptr += size; \
+    } else { \
+        BSB_SET_ERROR(b); \
+        x = 0; \
+    } \
+} while (0)
+
+#define BSB_IMPORT_bsb(b, x, size) \
+do { \
+    if ((b).ptr + size <= (b).end && \
+        (b).ptr + size >= (b).buf) { \
+        BSB_INIT(x, (b).ptr, size); \
+        (b).ptr += size; \
+    } else { \
+        BSB_SET_ERROR(b); \
+        BSB_INIT(x, NULL, 0); \
+    } \
+} while (0)
+
+#define BSB_IMPORT_skip(b, size) \
+do { \
+    if ((b).ptr + size <= (b).end && \
+        (b).ptr + size >= (b).buf) { \
+        (b).ptr += size; \
+    } else \
+        BSB_SET_ERROR(b); \
+} while (0)
+
+/******************************************************************************/
+/*
+ * Only the config, session and packet members the plugin reads
+ */
+typedef struct arkime_config {
+    int       packetThreads;
+    gboolean  debug;
+} ArkimeConfig_t;
+
+typedef struct arkime_session {
+    void                 **pluginData;
+    struct timeval         firstPacket;
+    uint32_t               tcpFlagAckCnt[2];
+    uint32_t               packets[2];
+    uint16_t               stopSaving;        // packets written before stopping, 0xffff is all
+    uint8_t                thread;
+    uint8_t                ipProtocol;
+} ArkimeSession_t;
+
+typedef struct arkime_packet {
+    struct timeval ts;
+    uint8_t       *pkt;
+    uint32_t       pktlen;
+    uint16_t       payloadLen;
+    uint16_t       payloadOffset;
+    uint16_t       ipOffset;
+    uint8_t        direction: 1;
+    uint8_t        v6: 1;
+} ArkimePacket_t;
+
+/******************************************************************************/
+/*
+ * http_parser, the methods and the members the plugin reads
+ */
+#define HTTP_METHOD_MAP(XX)         \
+  XX(0,  DELETE,      DELETE)       \
+  XX(1,  GET,         GET)          \
+  XX(2,  HEAD,        HEAD)         \
+  XX(3,  POST,        POST)         \
+  XX(4,  PUT,         PUT)          \
+  XX(5,  CONNECT,     CONNECT)      \
+  XX(6,  OPTIONS,     OPTIONS)      \
+  XX(7,  TRACE,       TRACE)        \
+  XX(8,  COPY,        COPY)         \
+  XX(9,  LOCK,        LOCK)         \
+  XX(10, MKCOL,       MKCOL)        \
+  XX(11, MOVE,        MOVE)         \
+  XX(12, PROPFIND,    PROPFIND)     \
+  XX(13, PROPPATCH,   PROPPATCH)    \
+  XX(14, SEARCH,      SEARCH)       \
+  XX(15, UNLOCK,      UNLOCK)       \
+  XX(16, BIND,        BIND)         \
+  XX(17, REBIND,      REBIND)       \
+  XX(18, UNBIND,      UNBIND)       \
+  XX(19, ACL,         ACL)          \
+  XX(20, REPORT,      REPORT)       \
+  XX(21, MKACTIVITY,  MKACTIVITY)   \
+  XX(22, CHECKOUT,    CHECKOUT)     \
+  XX(23, MERGE,       MERGE)        \
+  XX(24, MSEARCH,     M-SEARCH)     \
+  XX(25, NOTIFY,      NOTIFY)       \
+  XX(26, SUBSCRIBE,   SUBSCRIBE)    \
+  XX(27, UNSUBSCRIBE, UNSUBSCRIBE)  \
+  XX(28, PATCH,       PATCH)        \
+  XX(29, PURGE,       PURGE)        \
+  XX(30, MKCALENDAR,  MKCALENDAR)   \
+  XX(31, LINK,        LINK)         \
+  XX(32, UNLINK,      UNLINK)       \
+  XX(33, SOURCE,      SOURCE)       \
+
+enum http_method {
+#define XX(num, name, string) HTTP_##name = num,
+    HTTP_METHOD_MAP(XX)
+#undef XX
+};
+
+typedef struct http_parser {
+    unsigned int type : 2;
+    unsigned short http_major;
+    unsigned short http_minor;
+    unsigned int method : 8;
+    void *data;
+} http_parser;
+
+const char *http_method_str(enum http_method m);
+
+/******************************************************************************/
+/*
+ * Plugins, parsers, config and fields
+ */
+typedef uint32_t (*ArkimeParserNamedFunc)(ArkimeSession_t *session, const uint8_t *data, int len, void *uw);
+
+typedef void (*ArkimePluginIpFunc) (ArkimeSession_t *session, struct ip *packet, int len);
+typedef void (*ArkimePluginUdpFunc) (ArkimeSession_t *session, const uint8_t *data, int len, int which);
+typedef void (*ArkimePluginTcpFunc) (ArkimeSession_t *session, const uint8_t *data, int len, int which);
+typedef void (*ArkimePluginSaveFunc) (ArkimeSession_t *session, int final);
+typedef void (*ArkimePluginNewFunc) (ArkimeSession_t *session);
+typedef void (*ArkimePluginExitFunc) ();
+typedef void (*ArkimePluginReloadFunc) ();
+typedef void (*ArkimePluginHttpDataFunc) (ArkimeSession_t *session, http_parser *hp, const char *at, size_t length);
+typedef void (*ArkimePluginHttpFunc) (ArkimeSession_t *session, http_parser *hp);
+
+int  arkime_plugins_register(const char *name, gboolean storeData);
+
+void arkime_plugins_set_cb(const char *name,
+                           ArkimePluginIpFunc ipFunc,
+                           ArkimePluginUdpFunc udpFunc,
+                           ArkimePluginTcpFunc tcpFunc,
+                           ArkimePluginSaveFunc preSaveFunc,
+                           ArkimePluginSaveFunc saveFunc,
+                           ArkimePluginNewFunc newFunc,
+                           ArkimePluginExitFunc exitFunc,
+                           ArkimePluginReloadFunc reloadFunc);
+
+void arkime_plugins_set_http_ext_cb(const char *name,
+                                    ArkimePluginHttpFunc onMessageBegin,
+                                    ArkimePluginHttpDataFunc onUrl,
+                                    ArkimePluginHttpDataFunc onHeaderField,
+                                    ArkimePluginHttpDataFunc onHeaderFieldRaw,
+                                    ArkimePluginHttpDataFunc onHeaderValue,
+                                    ArkimePluginHttpFunc onHeadersComplete,
+                                    ArkimePluginHttpDataFunc onBody,
+                                    ArkimePluginHttpFunc onMessageComplete);
+
+void arkime_parsers_add_named_func(const char *name, ArkimeParserNamedFunc func);
+uint8_t *arkime_parsers_asn_get_tlv(BSB *bsb, uint32_t *apc, uint32_t *atag, uint32_t *alen);
+
+gboolean arkime_config_boolean(GKeyFile *keyfile, const char *key, gboolean d);
+int      arkime_config_int(GKeyFile *keyfile, const char *key, int d, int min, int max);
+char    *arkime_config_str(GKeyFile *keyfile, const char *key, const char *d);
+
+#define ARKIME_FIELD_TYPE_STR        4
+#define ARKIME_FIELD_TYPE_STR_ARRAY  5
+#define ARKIME_FIELD_TYPE_STR_GHASH  7
+
+#define ARKIME_FIELD_FLAG_CNT             0x0001
+#define ARKIME_FIELD_FLAG_FAKE            0x0400
+#define ARKIME_FIELD_FLAG_DIFF_FROM_LAST  0x0800
+
+int      arkime_field_define(const char *group, const char *kind, const char *expression, const char *friendlyName, const char *dbField, const char *help, int type, int flags, ...);
+gboolean arkime_field_string_add(int pos, ArkimeSession_t *session, const char *string, int len, gboolean copy);
+void     arkime_field_certsinfo_update_extra(void *cert, char *key, char *value);
+
+void     arkime_session_add_tag(ArkimeSession_t *session, const char *tag);
+void     arkime_free_later(void *ptr, GDestroyNotify cb);
+
+void arkime_plugin_init();
+
+#endif
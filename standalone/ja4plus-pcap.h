@@ -0,0 +1,68 @@
+/* ja4plus-pcap.h  -- offline JA4+ from pcap files using ja4plus.c
+ *
+ * The reader thread maps the files and hands each TCP packet to the worker
+ * that owns its flow, picked by a symmetric 5-tuple hash. Each worker is one
+ * of the plugin's packet threads, so the plugin's per thread state is used
+ * the same way it is in capture.
+ *
+ * SPDX-License-Identifier: FoxIO License 1.1
+ */
+
+#include "arkime.h"
+#include "../parsers/ssh_info.h"
+
+#define JP_MAX_WORKERS      ARKIME_MAX_PACKET_THREADS
+#define JP_RING_SIZE        8192            // packets queued per worker
+#define JP_MAX_FIELDS       32
+
+#define JP_OUTPUT_JSON      0
+#define JP_OUTPUT_CSV       1
+
+/* A packet in one of the mapped files, nothing is copied */
+typedef struct {
+    const uint8_t       *data;
+    struct timeval       ts;
+    uint32_t             caplen;
+    uint32_t             hash;
+    uint16_t             ipOffset;
+    uint16_t             tcpOffset;
+    uint16_t             ipLen;         // ip header to end of the ip payload
+    uint8_t              v6;
+} JPPacket_t;
+
+typedef struct {
+    int                  outputFormat;
+    int                  workers;
+    int                  tcpTimeout;
+    int                  allSessions;   // output sessions with no fingerprints
+    FILE                *out;
+} JPConfig_t;
+
+extern JPConfig_t        jpConfig;
+extern ArkimeConfig_t    config;
+
+/* api.c */
+void                  jp_api_init();
+void                  jp_api_tags_init();
+void                  jp_config_set(const char *keyValue);
+int                   jp_field_count();
+const char           *jp_field_name(int pos);
+ArkimeParserNamedFunc jp_named_func(const char *name);
+
+extern ArkimePluginSaveFunc      jpPreSave;
+extern ArkimePluginSaveFunc      jpSave;
+extern ArkimePluginExitFunc      jpExit;
+extern ArkimePluginHttpDataFunc  jpHeaderFieldRaw;
+extern ArkimePluginHttpDataFunc  jpHeaderValue;
+extern ArkimePluginHttpFunc      jpMessageComplete;
+
+/* session.c */
+void                  jp_worker_init(int thread);
+void                  jp_worker_packet(int thread, const JPPacket_t *packet);
+void                  jp_worker_finish(int thread);
+void                  jp_session_field_add(ArkimeSession_t *session, int pos, const char *value, int len);
+void                  jp_output_header();
+
+/* reader.c */
+int                   jp_reader_file(const char *filename, void (*cb)(const JPPacket_t *packet));
+void                  jp_reader_stats(uint64_t *read, uint64_t *skipped);
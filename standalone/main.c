@@ -0,0 +1,179 @@
+/* main.c  -- ja4plus-pcap, JA4+ fingerprints from pcap files without capture
+ *
+ * The main thread reads the files and passes packets to the workers over
+ * single producer single consumer rings, the tails are published in
+ * batches so the cache lines aren't shared per packet.
+ *
+ * SPDX-License-Identifier: FoxIO License 1.1
+ */
+
+#include <sched.h>
+#include <unistd.h>
+#include "ja4plus-pcap.h"
+
+#define JP_RING_MASK        (JP_RING_SIZE - 1)
+#define JP_RING_BATCH       64
+
+typedef struct {
+    JPPacket_t           packets[JP_RING_SIZE];
+    uint32_t             head __attribute__((aligned(64)));    // written by the worker
+    uint32_t             tail __attribute__((aligned(64)));    // written by the reader
+    uint32_t             writeTail;                            // reader's unpublished tail
+    pthread_t            thread;
+} JPRing_t;
+
+JPConfig_t               jpConfig;
+
+LOCAL JPRing_t          *rings;
+LOCAL int                readerDone;
+
+/******************************************************************************/
+LOCAL void usage()
+{
+    printf("ja4plus-pcap [options] <pcap files>\n"
+           "  -w workers         worker threads, default online cpus - 1\n"
+           "  -f json|csv        output format, default json (one session per line)\n"
+           "  -W file            output file, default stdout\n"
+           "  -t seconds         tcp idle timeout, default 480\n"
+           "  -a                 also output sessions with no fingerprints\n"
+           "  -o key=value       plugin setting, like the capture config, can repeat\n");
+    exit(1);
+}
+/******************************************************************************/
+LOCAL void jp_ring_publish(JPRing_t *ring)
+{
+    __atomic_store_n(&ring->tail, ring->writeTail, __ATOMIC_RELEASE);
+}
+/******************************************************************************/
+LOCAL void jp_reader_cb(const JPPacket_t *packet)
+{
+    JPRing_t *ring = &rings[packet->hash % jpConfig.workers];
+
+    while (ring->writeTail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >= JP_RING_SIZE) {
+        jp_ring_publish(ring);
+        sched_yield();
+    }
+
+    ring->packets[ring->writeTail & JP_RING_MASK] = *packet;
+    ring->writeTail++;
+    if ((ring->writeTail & (JP_RING_BATCH - 1)) == 0)
+        jp_ring_publish(ring);
+}
+/******************************************************************************/
+LOCAL void *jp_worker_thread(void *arg)
+{
+    int       thread = (long)arg;
+    JPRing_t *ring = &rings[thread];
+    uint32_t  head = ring->head;
+    int       idle = 0;
+
+    while (1) {
+        uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            if (__atomic_load_n(&readerDone, __ATOMIC_ACQUIRE) && head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+                break;
+            if (idle++ < 100)
+                sched_yield();
+            else
+                usleep(100);
+            continue;
+        }
+        idle = 0;
+
+        while (head != tail) {
+            jp_worker_packet(thread, &ring->packets[head & JP_RING_MASK]);
+            head++;
+            if ((head & (JP_RING_BATCH - 1)) == 0)
+                __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+    }
+
+    jp_worker_finish(thread);
+    return NULL;
+}
+/******************************************************************************/
+int main(int argc, char **argv)
+{
+    int  opt;
+    char *outFile = NULL;
+
+    jpConfig.workers = MIN(MAX(sysconf(_SC_NPROCESSORS_ONLN) - 1, 1), JP_MAX_WORKERS);
+    jpConfig.tcpTimeout = 480;
+
+    while ((opt = getopt(argc, argv, "w:f:W:t:ao:h")) != -1) {
+        switch (opt) {
+        case 'w':
+            jpConfig.workers = MIN(MAX(atoi(optarg), 1), JP_MAX_WORKERS);
+            break;
+        case 'f':
+            if (strcmp(optarg, "json") == 0)
+                jpConfig.outputFormat = JP_OUTPUT_JSON;
+            else if (strcmp(optarg, "csv") == 0)
+                jpConfig.outputFormat = JP_OUTPUT_CSV;
+            else
+                usage();
+            break;
+        case 'W':
+            outFile = optarg;
+            break;
+        case 't':
+            jpConfig.tcpTimeout = MAX(atoi(optarg), 1);
+            break;
+        case 'a':
+            jpConfig.allSessions = 1;
+            break;
+        case 'o':
+            jp_config_set(optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind == argc)
+        usage();
+
+    jpConfig.out = stdout;
+    if (outFile) {
+        jpConfig.out = fopen(outFile, "w");
+        if (!jpConfig.out)
+            LOGEXIT("ERROR - Can't open %s", outFile);
+    }
+
+    // Each worker is a packet thread to the plugin
+    jp_api_init();
+    config.packetThreads = jpConfig.workers;
+    arkime_plugin_init();
+    jp_api_tags_init();
+    jp_output_header();
+
+    rings = aligned_alloc(64, jpConfig.workers * sizeof(JPRing_t));
+    memset(rings, 0, jpConfig.workers * sizeof(JPRing_t));
+    for (long t = 0; t < jpConfig.workers; t++) {
+        jp_worker_init(t);
+        pthread_create(&rings[t].thread, NULL, jp_worker_thread, (void *)t);
+    }
+
+    int failed = 0;
+    for (int i = optind; i < argc; i++) {
+        if (jp_reader_file(argv[i], jp_reader_cb) != 0)
+            failed = 1;
+    }
+
+    for (int t = 0; t < jpConfig.workers; t++)
+        jp_ring_publish(&rings[t]);
+    __atomic_store_n(&readerDone, 1, __ATOMIC_RELEASE);
+    for (int t = 0; t < jpConfig.workers; t++)
+        pthread_join(rings[t].thread, NULL);
+
+    if (jpExit)
+        jpExit();
+
+    uint64_t read, skipped;
+    jp_reader_stats(&read, &skipped);
+    LOG("%" PRIu64 " packets read, %" PRIu64 " not TCP or not decodable, %d workers", read, skipped, jpConfig.workers);
+
+    fclose(jpConfig.out);
+    return failed;
+}
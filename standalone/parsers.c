@@ -0,0 +1,76 @@
+/* parsers.c  -- the capture parser helpers ja4plus.c calls
+ *
+ * Shared by bench/ and ja4plus-pcap, same behavior as capture.
+ *
+ * SPDX-License-Identifier: FoxIO License 1.1
+ */
+
+#include "arkime.h"
+
+/******************************************************************************/
+const char *http_method_str(enum http_method m)
+{
+    switch (m) {
+#define XX(num, name, string) case HTTP_##name: return #string;
+        HTTP_METHOD_MAP(XX)
+#undef XX
+    }
+    return "<unknown>";
+}
+/******************************************************************************/
+uint8_t *arkime_parsers_asn_get_tlv(BSB *bsb, uint32_t *apc, uint32_t *atag, uint32_t *alen)
+{
+
+    if (BSB_REMAINING(*bsb) < 2)
+        goto get_tlv_error;
+
+    u_char ch = 0;
+    BSB_IMPORT_u08(*bsb, ch);
+
+    *apc = (ch >> 5) & 0x1;
+    *atag = ch & 0x1f;
+
+    if (*atag == 0x1f) {
+        *atag = 0;
+        while (BSB_REMAINING(*bsb)) {
+            BSB_IMPORT_u08(*bsb, ch);
+            *atag = (*atag << 7) | ch;
+            if ((ch & 0x80) == 0)
+                break;
+        }
+    }
+
+    BSB_IMPORT_u08(*bsb, ch);
+    if (BSB_IS_ERROR(*bsb) || ch == 0x80) {
+        goto get_tlv_error;
+    }
+
+    if (ch & 0x80) {
+        int cnt = ch & 0x7f;
+        (*alen) = 0;
+        while (cnt > 0 && BSB_REMAINING(*bsb)) {
+            BSB_IMPORT_u08(*bsb, ch);
+            *alen = ((*alen) << 8) | ch;
+            cnt--;
+        }
+    } else {
+        (*alen) = ch;
+    }
+
+    if (*alen > BSB_REMAINING(*bsb))
+        *alen = BSB_REMAINING(*bsb);
+
+    uint8_t *value;
+    BSB_IMPORT_ptr(*bsb, value, *alen);
+    if (BSB_IS_ERROR(*bsb)) {
+        goto get_tlv_error;
+    }
+
+    return value;
+
+get_tlv_error:
+    (*apc) = 0;
+    (*alen) = 0;
+    (*atag) = 0;
+    return 0;
+}
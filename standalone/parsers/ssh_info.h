@@ -0,0 +1,11 @@
+/* ssh_info.h  -- stand in for capture/parsers/ssh_info.h used by the bench
+ *
+ * SPDX-License-Identifier: FoxIO License 1.1
+ */
+
+typedef struct {
+    uint16_t   packets[2];
+    uint16_t   packets200[2];
+    uint16_t   lens[2][200];
+    uint8_t    doneRS: 1;
+} SSHInfo_t;
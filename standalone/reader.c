@@ -0,0 +1,338 @@
+/* reader.c  -- map pcap and pcapng files and find the TCP packets
+ *
+ * Only decodes as far as the TCP header, enough to pick the worker. The
+ * file stays mapped until exit since the workers use the packets in place.
+ *
+ * SPDX-License-Identifier: FoxIO License 1.1
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ja4plus-pcap.h"
+
+#define JP_LINK_NULL      0
+#define JP_LINK_ETHER     1
+#define JP_LINK_RAW       101
+#define JP_LINK_SLL       113
+#define JP_LINK_LOOP      108
+#define JP_LINK_IPV4      228
+#define JP_LINK_IPV6      229
+#define JP_LINK_SLL2      276
+
+#define JP_PCAPNG_SHB     0x0A0D0D0A
+#define JP_PCAPNG_IDB     1
+#define JP_PCAPNG_SPB     3
+#define JP_PCAPNG_EPB     6
+#define JP_PCAPNG_MAX_IF  256
+
+typedef struct {
+    uint16_t   linkType;
+    uint8_t    swap;
+    uint64_t   tsDiv;       // ticks per second
+} JPInterface_t;
+
+LOCAL uint64_t               packetsRead;
+LOCAL uint64_t               packetsSkipped;
+
+/******************************************************************************/
+LOCAL inline uint16_t jp_get16(const uint8_t *p, int swap)
+{
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return swap ? __builtin_bswap16(v) : v;
+}
+/******************************************************************************/
+LOCAL inline uint32_t jp_get32(const uint8_t *p, int swap)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return swap ? __builtin_bswap32(v) : v;
+}
+/******************************************************************************/
+/* Same value for both directions of a flow */
+LOCAL uint32_t jp_flow_hash(const uint8_t *src, const uint8_t *dst, int addrLen, uint16_t sport, uint16_t dport)
+{
+    uint64_t a = sport, b = dport;
+
+    for (int i = 0; i < addrLen; i += 4) {
+        uint32_t s, d;
+        memcpy(&s, src + i, 4);
+        memcpy(&d, dst + i, 4);
+        a = (a ^ s) * 0x100000001b3ULL;
+        b = (b ^ d) * 0x100000001b3ULL;
+    }
+
+    uint64_t h = (a + b) ^ (a * b);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (uint32_t)h;
+}
+/******************************************************************************/
+/* Fill in the ip and tcp offsets, returns 0 if not a TCP packet we can use */
+LOCAL int jp_decode(JPPacket_t *packet, int linkType)
+{
+    const uint8_t *data = packet->data;
+    uint32_t       len = packet->caplen;
+    uint32_t       pos = 0;
+    uint16_t       ethertype = 0;
+
+    switch (linkType) {
+    case JP_LINK_ETHER:
+        if (len < 14)
+            return 0;
+        ethertype = data[12] << 8 | data[13];
+        pos = 14;
+        while ((ethertype == 0x8100 || ethertype == 0x88a8) && pos + 4 <= len) {
+            ethertype = data[pos + 2] << 8 | data[pos + 3];
+            pos += 4;
+        }
+        break;
+    case JP_LINK_SLL:
+        if (len < 16)
+            return 0;
+        ethertype = data[14] << 8 | data[15];
+        pos = 16;
+        break;
+    case JP_LINK_SLL2:
+        if (len < 20)
+            return 0;
+        ethertype = data[0] << 8 | data[1];
+        pos = 20;
+        break;
+    case JP_LINK_NULL:
+    case JP_LINK_LOOP:
+        if (len < 4)
+            return 0;
+        pos = 4;
+        // The family differs between systems so use the ip version
+        // fall through
+    case JP_LINK_RAW:
+    case JP_LINK_IPV4:
+    case JP_LINK_IPV6:
+        if (pos >= len)
+            return 0;
+        ethertype = (data[pos] >> 4) == 6 ? 0x86dd : 0x0800;
+        break;
+    default:
+        return 0;
+    }
+
+    packet->ipOffset = pos;
+
+    const uint8_t *src, *dst;
+    int            addrLen;
+    uint32_t       ipEnd;
+
+    if (ethertype == 0x0800) {
+        if (pos + 20 > len || (data[pos] >> 4) != 4)
+            return 0;
+        const struct ip *ip4 = (const struct ip *)(data + pos);
+        uint32_t hl = ip4->ip_hl * 4;
+        if (ip4->ip_p != IPPROTO_TCP || hl < 20 || (ntohs(ip4->ip_off) & 0x3fff))
+            return 0;
+        ipEnd = pos + MAX(ntohs(ip4->ip_len), hl);
+        src = data + pos + 12;
+        dst = data + pos + 16;
+        addrLen = 4;
+        pos += hl;
+        packet->v6 = 0;
+    } else if (ethertype == 0x86dd) {
+        if (pos + 40 > len || (data[pos] >> 4) != 6)
+            return 0;
+        const struct ip6_hdr *ip6 = (const struct ip6_hdr *)(data + pos);
+        ipEnd = pos + 40 + ntohs(ip6->ip6_plen);
+        src = data + pos + 8;
+        dst = data + pos + 24;
+        addrLen = 16;
+
+        // Skip hop by hop, routing and destination options, fragments are ignored
+        uint8_t next = ip6->ip6_nxt;
+        pos += 40;
+        while ((next == 0 || next == 43 || next == 60) && pos + 8 <= len) {
+            next = data[pos];
+            pos += (data[pos + 1] + 1) * 8;
+        }
+        if (next != IPPROTO_TCP)
+            return 0;
+        packet->v6 = 1;
+    } else {
+        return 0;
+    }
+
+    if (pos + 20 > len)
+        return 0;
+    const struct tcphdr *tcp = (const struct tcphdr *)(data + pos);
+    if (tcp->th_off < 5 || pos + tcp->th_off * 4 > len)
+        return 0;
+
+    packet->tcpOffset = pos;
+    packet->ipLen = MIN(ipEnd, len) - packet->ipOffset;
+    packet->hash = jp_flow_hash(src, dst, addrLen, tcp->th_sport, tcp->th_dport);
+    return 1;
+}
+/******************************************************************************/
+LOCAL void jp_packet(const uint8_t *data, uint32_t caplen, uint64_t sec, uint64_t usec, int linkType, void (*cb)(const JPPacket_t *packet))
+{
+    JPPacket_t packet;
+
+    packetsRead++;
+    packet.data = data;
+    packet.caplen = caplen;
+    packet.ts.tv_sec = sec;
+    packet.ts.tv_usec = usec;
+    if (!jp_decode(&packet, linkType)) {
+        packetsSkipped++;
+        return;
+    }
+    cb(&packet);
+}
+/******************************************************************************/
+LOCAL int jp_reader_pcap(const char *filename, const uint8_t *map, size_t size, void (*cb)(const JPPacket_t *packet))
+{
+    uint32_t magic = jp_get32(map, 0);
+    int      swap = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+    int      nano = magic == 0xa1b23c4d || magic == 0x4d3cb2a1;
+    int      linkType = jp_get32(map + 20, swap) & 0xffff;
+    size_t   pos = 24;
+
+    while (pos + 16 <= size) {
+        uint32_t sec = jp_get32(map + pos, swap);
+        uint32_t frac = jp_get32(map + pos + 4, swap);
+        uint32_t caplen = jp_get32(map + pos + 8, swap);
+        pos += 16;
+
+        if (caplen > size - pos) {
+            LOG("WARNING - %s truncated", filename);
+            break;
+        }
+        jp_packet(map + pos, caplen, sec, nano ? frac / 1000 : frac, linkType, cb);
+        pos += caplen;
+    }
+    return 0;
+}
+/******************************************************************************/
+LOCAL int jp_reader_pcapng(const char *filename, const uint8_t *map, size_t size, void (*cb)(const JPPacket_t *packet))
+{
+    JPInterface_t interfaces[JP_PCAPNG_MAX_IF];
+    int           interfacesNum = 0;
+    int           swap = 0;
+    size_t        pos = 0;
+
+    while (pos + 12 <= size) {
+        uint32_t type = jp_get32(map + pos, swap);
+
+        // Each section says its own byte order
+        if (type == JP_PCAPNG_SHB) {
+            uint32_t bom = jp_get32(map + pos + 8, 0);
+            if (bom == 0x1a2b3c4d)
+                swap = 0;
+            else if (bom == 0x4d3c2b1a)
+                swap = 1;
+            else
+                LOGEXIT("%s bad pcapng byte order", filename);
+            interfacesNum = 0;
+        }
+
+        uint32_t blockLen = jp_get32(map + pos + 4, swap);
+        if (blockLen < 12 || blockLen > size - pos) {
+            LOG("WARNING - %s truncated", filename);
+            break;
+        }
+        const uint8_t *body = map + pos + 8;
+        uint32_t       bodyLen = blockLen - 12;
+
+        switch (type) {
+        case JP_PCAPNG_IDB:
+            if (interfacesNum < JP_PCAPNG_MAX_IF && bodyLen >= 8) {
+                JPInterface_t *intf = &interfaces[interfacesNum++];
+                intf->linkType = jp_get16(body, swap);
+                intf->tsDiv = 1000000;
+
+                // if_tsresol is the only option we need
+                for (uint32_t o = 8; o + 4 <= bodyLen;) {
+                    uint16_t code = jp_get16(body + o, swap);
+                    uint16_t olen = jp_get16(body + o + 2, swap);
+                    if (code == 0)
+                        break;
+                    if (code == 9 && olen >= 1 && o + 5 <= bodyLen) {
+                        uint8_t  res = body[o + 4];
+                        uint64_t div = 1;
+                        for (int i = 0; i < (res & 0x7f) && div < 1000000000000000000ULL; i++)
+                            div *= (res & 0x80) ? 2 : 10;
+                        intf->tsDiv = div;
+                    }
+                    o += 4 + ((olen + 3) & ~3);
+                }
+            }
+            break;
+        case JP_PCAPNG_EPB: {
+            if (bodyLen < 20)
+                break;
+            uint32_t id = jp_get32(body, swap);
+            if (id >= (uint32_t)interfacesNum)
+                break;
+            uint64_t ts = (uint64_t)jp_get32(body + 4, swap) << 32 | jp_get32(body + 8, swap);
+            uint32_t caplen = MIN(jp_get32(body + 12, swap), bodyLen - 20);
+            uint64_t div = interfaces[id].tsDiv;
+            jp_packet(body + 20, caplen, ts / div, (ts % div) * 1000000 / div, interfaces[id].linkType, cb);
+            break;
+        }
+        case JP_PCAPNG_SPB:
+            if (bodyLen < 4 || interfacesNum == 0)
+                break;
+            jp_packet(body + 4, MIN(jp_get32(body, swap), bodyLen - 4), 0, 0, interfaces[0].linkType, cb);
+            break;
+        }
+        pos += blockLen;
+    }
+    return 0;
+}
+/******************************************************************************/
+int jp_reader_file(const char *filename, void (*cb)(const JPPacket_t *packet))
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        LOG("ERROR - Can't open %s: %s", filename, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < 24) {
+        LOG("ERROR - %s is too short", filename);
+        close(fd);
+        return -1;
+    }
+
+    const uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG("ERROR - Can't map %s: %s", filename, strerror(errno));
+        return -1;
+    }
+    madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+
+    uint32_t magic = jp_get32(map, 0);
+    switch (magic) {
+    case 0xa1b2c3d4:
+    case 0xd4c3b2a1:
+    case 0xa1b23c4d:
+    case 0x4d3cb2a1:
+        return jp_reader_pcap(filename, map, st.st_size, cb);
+    case JP_PCAPNG_SHB:
+        return jp_reader_pcapng(filename, map, st.st_size, cb);
+    }
+
+    LOG("ERROR - %s is not a pcap or pcapng file", filename);
+    munmap((void *)map, st.st_size);
+    return -1;
+}
+/******************************************************************************/
+void jp_reader_stats(uint64_t *read, uint64_t *skipped)
+{
+    *read = packetsRead;
+    *skipped = packetsSkipped;
+}
@@ -0,0 +1,707 @@
+/* session.c  -- per worker flow table, just enough reassembly to feed
+ * the plugin, and the output
+ *
+ * Only the bytes the fingerprints need are reassembled: the server side of
+ * TLS up to the end of the certificates, and the client side of HTTP
+ * requests. SSH lengths are counted by packet and handed over 200 at a time,
+ * and whatever is left when the session ends, like the capture ssh parser.
+ *
+ * SPDX-License-Identifier: FoxIO License 1.1
+ */
+
+#include "ja4plus-pcap.h"
+
+#define JP_PROTO_UNKNOWN    0
+#define JP_PROTO_TLS        1
+#define JP_PROTO_HTTP       2
+#define JP_PROTO_SSH        3
+#define JP_PROTO_NONE       4
+
+#define JP_STREAM_MAX       (256 * 1024)    // bytes held waiting for a full message
+#define JP_SEGMENTS_MAX     16              // out of order segments held per direction
+#define JP_CLOSING_TIMEOUT  5
+#define JP_OUT_FLUSH        (256 * 1024)
+
+typedef struct jp_segment {
+    struct jp_segment   *next;
+    uint32_t             seq;
+    uint32_t             len;
+    uint8_t              data[];
+} JPSegment_t;
+
+typedef struct {
+    GString             *buf;           // in order bytes not used yet
+    GString             *handshake;     // tls handshake messages split across records
+    JPSegment_t         *segments;      // out of order, sorted by seq
+    uint32_t             nextSeq;
+    uint8_t              segmentsNum;
+    uint8_t              proto;
+    uint8_t              seqSet: 1;
+    uint8_t              done: 1;
+    uint8_t              chunked: 1;
+    uint64_t             bodyLeft;      // http body bytes to skip
+} JPStream_t;
+
+typedef struct jp_session {
+    ArkimeSession_t      session;       // first, the plugin's session is ours
+    void                *pluginData[1];
+    struct jp_session   *hnext;
+    struct jp_session   *lprev;
+    struct jp_session   *lnext;
+    struct timeval       lastPacket;
+    uint32_t             hash;
+    uint8_t              addr[2][16];   // client then server
+    uint16_t             port[2];       // network order
+    uint8_t              v6;
+    uint8_t              fin;           // bit per direction
+    uint8_t              closing;
+    JPStream_t           stream[2];
+    SSHInfo_t           *ssh;
+    http_parser          parser;
+    GString             *fields;        // pos, len (2 bytes), value ...
+} JPSession_t;
+
+typedef struct {
+    JPSession_t        **buckets;
+    uint32_t             mask;
+    uint32_t             num;
+    JPSession_t         *lruHead[2];    // open and closing, least recently seen first
+    JPSession_t         *lruTail[2];
+    GString             *out;
+    GString             *cell;          // csv cell being joined
+} JPWorker_t;
+
+LOCAL JPWorker_t             workers[JP_MAX_WORKERS];
+LOCAL pthread_mutex_t        output_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+LOCAL ArkimeParserNamedFunc  serverHelloFunc;
+LOCAL ArkimeParserNamedFunc  certificateFunc;
+LOCAL ArkimeParserNamedFunc  sshFunc;
+LOCAL ArkimeParserNamedFunc  tcpRawFunc;
+
+/******************************************************************************/
+void jp_session_field_add(ArkimeSession_t *session, int pos, const char *value, int len)
+{
+    JPSession_t *jps = (JPSession_t *)session;
+
+    if (!jps->fields)
+        jps->fields = g_string_sized_new(128);
+
+    uint8_t hdr[3] = {pos, len >> 8, len & 0xff};
+    g_string_append_len(jps->fields, (char *)hdr, 3);
+    g_string_append_len(jps->fields, value, len);
+}
+/******************************************************************************/
+LOCAL void jp_output_flush(JPWorker_t *worker)
+{
+    ARKIME_LOCK(output);
+    fwrite(worker->out->str, 1, worker->out->len, jpConfig.out);
+    ARKIME_UNLOCK(output);
+    g_string_truncate(worker->out, 0);
+}
+/******************************************************************************/
+LOCAL void jp_output_string(GString *out, const char *str, int len)
+{
+    if (jpConfig.outputFormat == JP_OUTPUT_CSV) {
+        if (memchr(str, '"', len) || memchr(str, ',', len) || memchr(str, ';', len)) {
+            g_string_append_c(out, '"');
+            for (int i = 0; i < len; i++) {
+                if (str[i] == '"')
+                    g_string_append_c(out, '"');
+                g_string_append_c(out, str[i]);
+            }
+            g_string_append_c(out, '"');
+        } else {
+            g_string_append_len(out, str, len);
+        }
+        return;
+    }
+
+    g_string_append_c(out, '"');
+    for (int i = 0; i < len; i++) {
+        uint8_t ch = str[i];
+        if (ch == '"' || ch == '\\') {
+            g_string_append_c(out, '\\');
+            g_string_append_c(out, ch);
+        } else if (ch < 0x20) {
+            g_string_append_printf(out, "\\u%04x", ch);
+        } else {
+            g_string_append_c(out, ch);
+        }
+    }
+    g_string_append_c(out, '"');
+}
+/******************************************************************************/
+void jp_output_header()
+{
+    if (jpConfig.outputFormat != JP_OUTPUT_CSV)
+        return;
+
+    fprintf(jpConfig.out, "firstPacket,src,sport,dst,dport");
+    for (int pos = 1; pos < jp_field_count(); pos++)
+        fprintf(jpConfig.out, ",%s", jp_field_name(pos));
+    fprintf(jpConfig.out, "\n");
+}
+/******************************************************************************/
+LOCAL void jp_output_session(JPWorker_t *worker, JPSession_t *jps)
+{
+    GString *out = worker->out;
+    char     src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+    int      csv = jpConfig.outputFormat == JP_OUTPUT_CSV;
+
+    inet_ntop(jps->v6 ? AF_INET6 : AF_INET, jps->addr[0], src, sizeof(src));
+    inet_ntop(jps->v6 ? AF_INET6 : AF_INET, jps->addr[1], dst, sizeof(dst));
+
+    if (csv) {
+        g_string_append_printf(out, "%ld.%06ld,%s,%u,%s,%u",
+                               (long)jps->session.firstPacket.tv_sec, (long)jps->session.firstPacket.tv_usec,
+                               src, ntohs(jps->port[0]), dst, ntohs(jps->port[1]));
+    } else {
+        g_string_append_printf(out, "{\"firstPacket\":%ld.%06ld,\"src\":\"%s\",\"sport\":%u,\"dst\":\"%s\",\"dport\":%u",
+                               (long)jps->session.firstPacket.tv_sec, (long)jps->session.firstPacket.tv_usec,
+                               src, ntohs(jps->port[0]), dst, ntohs(jps->port[1]));
+    }
+
+    // Values for each field in define order, json arrays or one ; separated csv cell
+    const uint8_t *fields = jps->fields ? (uint8_t *)jps->fields->str : NULL;
+    uint32_t       fieldsLen = jps->fields ? jps->fields->len : 0;
+    for (int pos = 1; pos < jp_field_count(); pos++) {
+        int num = 0;
+
+        g_string_truncate(worker->cell, 0);
+        for (uint32_t f = 0; f < fieldsLen; f += 3 + (fields[f + 1] << 8 | fields[f + 2])) {
+            if (fields[f] != pos)
+                continue;
+            if (csv) {
+                if (num)
+                    g_string_append_c(worker->cell, ';');
+                g_string_append_len(worker->cell, (char *)fields + f + 3, fields[f + 1] << 8 | fields[f + 2]);
+            } else {
+                g_string_append_printf(out, num ? "," : ",\"%s\":[", jp_field_name(pos));
+                jp_output_string(out, (char *)fields + f + 3, fields[f + 1] << 8 | fields[f + 2]);
+            }
+            num++;
+        }
+
+        if (csv) {
+            g_string_append_c(out, ',');
+            jp_output_string(out, worker->cell->str, worker->cell->len);
+        } else if (num) {
+            g_string_append_c(out, ']');
+        }
+    }
+    g_string_append(out, csv ? "\n" : "}\n");
+
+    if (out->len >= JP_OUT_FLUSH)
+        jp_output_flush(worker);
+}
+/******************************************************************************/
+LOCAL void jp_stream_free(JPStream_t *stream)
+{
+    if (stream->buf) {
+        g_string_free(stream->buf, TRUE);
+        stream->buf = NULL;
+    }
+    if (stream->handshake) {
+        g_string_free(stream->handshake, TRUE);
+        stream->handshake = NULL;
+    }
+    while (stream->segments) {
+        JPSegment_t *segment = stream->segments;
+        stream->segments = segment->next;
+        g_free(segment);
+    }
+    stream->segmentsNum = 0;
+}
+/******************************************************************************/
+LOCAL void jp_stream_done(JPStream_t *stream)
+{
+    stream->done = 1;
+    jp_stream_free(stream);
+}
+/******************************************************************************/
+/* The server side of a TLS session, ServerHello and Certificate, stops at
+ * ServerHelloDone or anything that isn't a handshake record
+ */
+LOCAL void jp_parse_tls(JPSession_t *jps, JPStream_t *stream)
+{
+    const uint8_t *data = (uint8_t *)stream->buf->str;
+    uint32_t       len = stream->buf->len;
+    uint32_t       pos = 0;
+
+    while (!stream->done && len - pos >= 5) {
+        const uint8_t *record = data + pos;
+        uint32_t       recordLen = record[3] << 8 | record[4];
+
+        if (record[0] != 22 || record[1] != 3) {
+            jp_stream_done(stream);
+            return;
+        }
+        if (len - pos < 5 + recordLen)
+            break;
+        pos += 5 + recordLen;
+
+        if (!stream->handshake)
+            stream->handshake = g_string_sized_new(recordLen);
+        g_string_append_len(stream->handshake, (char *)record + 5, recordLen);
+
+        const uint8_t *hs = (uint8_t *)stream->handshake->str;
+        uint32_t       hsLen = stream->handshake->len;
+        uint32_t       hsPos = 0;
+        while (hsLen - hsPos >= 4) {
+            uint8_t  type = hs[hsPos];
+            uint32_t msgLen = hs[hsPos + 1] << 16 | hs[hsPos + 2] << 8 | hs[hsPos + 3];
+            if (hsLen - hsPos - 4 < msgLen)
+                break;
+
+            const uint8_t *msg = hs + hsPos + 4;
+            hsPos += 4 + msgLen;
+
+            if (type == 2 && serverHelloFunc) {
+                serverHelloFunc(&jps->session, msg, msgLen, NULL);
+            } else if (type == 11 && certificateFunc) {
+                BSB bsb;
+                BSB_INIT(bsb, msg, msgLen);
+                BSB_IMPORT_skip(bsb, 3);
+                while (BSB_REMAINING(bsb) > 3) {
+                    uint8_t *cert = BSB_WORK_PTR(bsb);
+                    uint32_t certLen = cert[0] << 16 | cert[1] << 8 | cert[2];
+                    BSB_IMPORT_skip(bsb, 3 + certLen);
+                    if (BSB_IS_ERROR(bsb))
+                        break;
+                    certificateFunc(&jps->session, cert + 3, certLen, &jps->session);
+                }
+            } else if (type == 14) {
+                jp_stream_done(stream);
+                return;
+            }
+        }
+        g_string_erase(stream->handshake, 0, hsPos);
+    }
+
+    if (!stream->done)
+        g_string_erase(stream->buf, 0, pos);
+}
+/******************************************************************************/
+/* Request method or -1 */
+LOCAL int jp_http_method(const char *str, int len)
+{
+    for (int m = 0; m < 256; m++) {
+        const char *name = http_method_str(m);
+        if (name[0] == '<')
+            continue;
+        if ((int)strlen(name) == len && memcmp(name, str, len) == 0)
+            return m;
+    }
+    return -1;
+}
+/******************************************************************************/
+/* The client side of HTTP, each request's headers go to the plugin. Bodies
+ * are skipped by Content-Length, chunked bodies end parsing.
+ */
+LOCAL void jp_parse_http(JPSession_t *jps, JPStream_t *stream)
+{
+    while (!stream->done) {
+        char    *data = stream->buf->str;
+        uint32_t len = stream->buf->len;
+
+        if (stream->bodyLeft) {
+            uint32_t skip = MIN(stream->bodyLeft, len);
+            stream->bodyLeft -= skip;
+            g_string_erase(stream->buf, 0, skip);
+            if (stream->bodyLeft)
+                return;
+            continue;
+        }
+        if (stream->chunked) {
+            jp_stream_done(stream);
+            return;
+        }
+
+        char *end = memmem(data, len, "\r\n\r\n", 4);
+        if (!end) {
+            if (len > 64 * 1024)
+                jp_stream_done(stream);
+            return;
+        }
+
+        // Request line
+        char *eol = memchr(data, '\r', end - data);
+        if (!eol)
+            eol = end;
+        char *sp = memchr(data, ' ', eol - data);
+        int   method = sp ? jp_http_method(data, sp - data) : -1;
+        char *version = eol - data >= 8 ? eol - 8 : NULL;
+        if (method < 0 || !version || memcmp(version, "HTTP/", 5) != 0 || !isdigit(version[5]) || !isdigit(version[7])) {
+            jp_stream_done(stream);
+            return;
+        }
+
+        memset(&jps->parser, 0, sizeof(jps->parser));
+        jps->parser.type = 0; // HTTP_REQUEST
+        jps->parser.method = method;
+        jps->parser.http_major = version[5] - '0';
+        jps->parser.http_minor = version[7] - '0';
+
+        // Header lines
+        for (char *line = eol + 2; line < end; ) {
+            char *lineEnd = memmem(line, end + 2 - line, "\r\n", 2);
+            char *colon = memchr(line, ':', lineEnd - line);
+            if (colon && line[0] != ' ' && line[0] != '\t') {
+                char *value = colon + 1;
+                while (value < lineEnd && (*value == ' ' || *value == '\t'))
+                    value++;
+                int valueLen = lineEnd - value;
+                while (valueLen > 0 && (value[valueLen - 1] == ' ' || value[valueLen - 1] == '\t'))
+                    valueLen--;
+
+                jpHeaderFieldRaw(&jps->session, &jps->parser, line, colon - line);
+                jpHeaderValue(&jps->session, &jps->parser, value, valueLen);
+
+                if (colon - line == 14 && strncasecmp(line, "Content-Length", 14) == 0)
+                    stream->bodyLeft = g_ascii_strtoull(value, NULL, 10);
+                else if (colon - line == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0 && g_strstr_len(value, valueLen, "chunked"))
+                    stream->chunked = 1;
+            }
+            line = lineEnd + 2;
+        }
+        jpMessageComplete(&jps->session, &jps->parser);
+
+        g_string_erase(stream->buf, 0, end + 4 - data);
+    }
+}
+/******************************************************************************/
+/* Pick the parser from the first bytes each side sends */
+LOCAL void jp_stream_detect(JPSession_t *jps, int which, const uint8_t *data, int len)
+{
+    JPStream_t *stream = &jps->stream[which];
+
+    if (len >= 4 && memcmp(data, "SSH-", 4) == 0) {
+        if (sshFunc && !jps->ssh)
+            jps->ssh = ARKIME_TYPE_ALLOC0(SSHInfo_t);
+        jp_stream_done(&jps->stream[0]);
+        jp_stream_done(&jps->stream[1]);
+        return;
+    }
+
+    if (which == 1 && len >= 3 && data[0] == 22 && data[1] == 3 && (serverHelloFunc || certificateFunc)) {
+        stream->proto = JP_PROTO_TLS;
+        return;
+    }
+
+    if (which == 0 && jpMessageComplete) {
+        const uint8_t *sp = memchr(data, ' ', MIN(len, 12));
+        if (sp && jp_http_method((char *)data, sp - data) >= 0) {
+            stream->proto = JP_PROTO_HTTP;
+            return;
+        }
+    }
+
+    stream->proto = JP_PROTO_NONE;
+    jp_stream_done(stream);
+}
+/******************************************************************************/
+LOCAL void jp_stream_append(JPStream_t *stream, const uint8_t *data, uint32_t len)
+{
+    if (!stream->buf)
+        stream->buf = g_string_sized_new(MAX(len, 1500));
+    g_string_append_len(stream->buf, (char *)data, len);
+    stream->nextSeq += len;
+}
+/******************************************************************************/
+/* Add in order data, holding a few segments that arrive early */
+LOCAL void jp_stream_add(JPSession_t *jps, int which, uint32_t seq, const uint8_t *data, uint32_t len)
+{
+    JPStream_t *stream = &jps->stream[which];
+
+    if (!stream->seqSet) {
+        stream->nextSeq = seq;
+        stream->seqSet = 1;
+    }
+
+    int32_t diff = seq - stream->nextSeq;
+    if (diff > 0) {
+        if (stream->segmentsNum == JP_SEGMENTS_MAX) {
+            jp_stream_done(stream);
+            return;
+        }
+        JPSegment_t *segment = g_malloc(sizeof(JPSegment_t) + len);
+        segment->seq = seq;
+        segment->len = len;
+        memcpy(segment->data, data, len);
+
+        JPSegment_t **prev = &stream->segments;
+        while (*prev && (int32_t)((*prev)->seq - seq) < 0)
+            prev = &(*prev)->next;
+        segment->next = *prev;
+        *prev = segment;
+        stream->segmentsNum++;
+        return;
+    }
+
+    // Retransmits and overlaps only add the new part
+    if ((uint32_t)-diff >= len)
+        return;
+    jp_stream_append(stream, data - diff, len + diff);
+
+    while (stream->segments && (int32_t)(stream->segments->seq - stream->nextSeq) <= 0) {
+        JPSegment_t *segment = stream->segments;
+        uint32_t     skip = stream->nextSeq - segment->seq;
+        stream->segments = segment->next;
+        stream->segmentsNum--;
+        if (skip < segment->len)
+            jp_stream_append(stream, segment->data + skip, segment->len - skip);
+        g_free(segment);
+    }
+
+    if (stream->proto == JP_PROTO_UNKNOWN)
+        jp_stream_detect(jps, which, (uint8_t *)stream->buf->str, stream->buf->len);
+
+    if (stream->proto == JP_PROTO_TLS)
+        jp_parse_tls(jps, stream);
+    else if (stream->proto == JP_PROTO_HTTP)
+        jp_parse_http(jps, stream);
+
+    if (!stream->done && stream->buf && stream->buf->len > JP_STREAM_MAX)
+        jp_stream_done(stream);
+}
+/******************************************************************************/
+LOCAL void jp_lru_remove(JPWorker_t *worker, JPSession_t *jps)
+{
+    if (jps->lprev)
+        jps->lprev->lnext = jps->lnext;
+    else
+        worker->lruHead[jps->closing] = jps->lnext;
+    if (jps->lnext)
+        jps->lnext->lprev = jps->lprev;
+    else
+        worker->lruTail[jps->closing] = jps->lprev;
+}
+/******************************************************************************/
+LOCAL void jp_lru_append(JPWorker_t *worker, JPSession_t *jps)
+{
+    jps->lnext = NULL;
+    jps->lprev = worker->lruTail[jps->closing];
+    if (worker->lruTail[jps->closing])
+        worker->lruTail[jps->closing]->lnext = jps;
+    else
+        worker->lruHead[jps->closing] = jps;
+    worker->lruTail[jps->closing] = jps;
+}
+/******************************************************************************/
+LOCAL void jp_session_end(JPWorker_t *worker, JPSession_t *jps)
+{
+    // Like the capture ssh parser's save, hand over a partial 200
+    if (jps->ssh && jps->ssh->packets200[0] + jps->ssh->packets200[1] > 0)
+        sshFunc(&jps->session, NULL, 0, jps->ssh);
+
+    if (jpPreSave)
+        jpPreSave(&jps->session, TRUE);
+    jpSave(&jps->session, TRUE);
+
+    if (jps->fields || jpConfig.allSessions)
+        jp_output_session(worker, jps);
+
+    JPSession_t **prev = &worker->buckets[jps->hash & worker->mask];
+    while (*prev != jps)
+        prev = &(*prev)->hnext;
+    *prev = jps->hnext;
+    worker->num--;
+    jp_lru_remove(worker, jps);
+
+    jp_stream_free(&jps->stream[0]);
+    jp_stream_free(&jps->stream[1]);
+    if (jps->ssh)
+        ARKIME_TYPE_FREE(SSHInfo_t, jps->ssh);
+    if (jps->fields)
+        g_string_free(jps->fields, TRUE);
+    ARKIME_TYPE_FREE(JPSession_t, jps);
+}
+/******************************************************************************/
+LOCAL void jp_worker_grow(JPWorker_t *worker)
+{
+    uint32_t      size = (worker->mask + 1) * 2;
+    JPSession_t **buckets = g_malloc0(size * sizeof(JPSession_t *));
+
+    for (uint32_t b = 0; b <= worker->mask; b++) {
+        JPSession_t *jps = worker->buckets[b];
+        while (jps) {
+            JPSession_t *next = jps->hnext;
+            jps->hnext = buckets[jps->hash & (size - 1)];
+            buckets[jps->hash & (size - 1)] = jps;
+            jps = next;
+        }
+    }
+    g_free(worker->buckets);
+    worker->buckets = buckets;
+    worker->mask = size - 1;
+}
+/******************************************************************************/
+/* End sessions idle past the timeout, packet time not wall time. Checked
+ * before every packet so the result doesn't depend on the worker count.
+ */
+LOCAL void jp_worker_sweep(JPWorker_t *worker, const struct timeval *now)
+{
+    for (int closing = 0; closing < 2; closing++) {
+        int64_t timeout = closing ? MIN(JP_CLOSING_TIMEOUT, jpConfig.tcpTimeout) : jpConfig.tcpTimeout;
+        while (worker->lruHead[closing]) {
+            JPSession_t *jps = worker->lruHead[closing];
+            if ((now->tv_sec - jps->lastPacket.tv_sec - timeout) * 1000000 + now->tv_usec - jps->lastPacket.tv_usec <= 0)
+                break;
+            jp_session_end(worker, jps);
+        }
+    }
+}
+/******************************************************************************/
+void jp_worker_packet(int thread, const JPPacket_t *packet)
+{
+    JPWorker_t          *worker = &workers[thread];
+    const uint8_t       *data = packet->data;
+    const struct tcphdr *tcp = (const struct tcphdr *)(data + packet->tcpOffset);
+    const uint8_t       *src, *dst;
+    int                  addrLen;
+
+    if (packet->v6) {
+        src = data + packet->ipOffset + 8;
+        dst = data + packet->ipOffset + 24;
+        addrLen = 16;
+    } else {
+        src = data + packet->ipOffset + 12;
+        dst = data + packet->ipOffset + 16;
+        addrLen = 4;
+    }
+
+    jp_worker_sweep(worker, &packet->ts);
+
+    // Find the session and which side sent this
+    JPSession_t *jps;
+    int          which = 0;
+    for (jps = worker->buckets[packet->hash & worker->mask]; jps; jps = jps->hnext) {
+        if (jps->hash != packet->hash || jps->v6 != packet->v6)
+            continue;
+        if (jps->port[0] == tcp->th_sport && jps->port[1] == tcp->th_dport &&
+            memcmp(jps->addr[0], src, addrLen) == 0 && memcmp(jps->addr[1], dst, addrLen) == 0) {
+            which = 0;
+            break;
+        }
+        if (jps->port[0] == tcp->th_dport && jps->port[1] == tcp->th_sport &&
+            memcmp(jps->addr[0], dst, addrLen) == 0 && memcmp(jps->addr[1], src, addrLen) == 0) {
+            which = 1;
+            break;
+        }
+    }
+
+    if (!jps) {
+        jps = ARKIME_TYPE_ALLOC0(JPSession_t);
+        jps->session.pluginData = jps->pluginData;
+        jps->session.firstPacket = packet->ts;
+        jps->session.thread = thread;
+        jps->session.ipProtocol = IPPROTO_TCP;
+        jps->session.stopSaving = 0xffff;
+        jps->hash = packet->hash;
+        jps->v6 = packet->v6;
+
+        // A SYN/ACK first means the receiver is the client
+        which = (tcp->th_flags & (TH_SYN | TH_ACK)) == (TH_SYN | TH_ACK);
+        memcpy(jps->addr[which], src, addrLen);
+        memcpy(jps->addr[!which], dst, addrLen);
+        jps->port[which] = tcp->th_sport;
+        jps->port[!which] = tcp->th_dport;
+
+        jps->hnext = worker->buckets[jps->hash & worker->mask];
+        worker->buckets[jps->hash & worker->mask] = jps;
+        worker->num++;
+        if (worker->num > 2 * (worker->mask + 1))
+            jp_worker_grow(worker);
+    } else {
+        jp_lru_remove(worker, jps);
+    }
+    jps->lastPacket = packet->ts;
+    jps->session.packets[which]++;
+
+    // Lengths from the ip header, a short ip length means no data
+    uint32_t tcpLen = MAX(packet->ipLen - (packet->tcpOffset - packet->ipOffset), (uint32_t)tcp->th_off * 4);
+    uint32_t dataLen = tcpLen - tcp->th_off * 4;
+
+    if (tcpRawFunc) {
+        ArkimePacket_t arkimePacket;
+        memset(&arkimePacket, 0, sizeof(arkimePacket));
+        arkimePacket.ts = packet->ts;
+        arkimePacket.pkt = (uint8_t *)data;
+        arkimePacket.pktlen = packet->caplen;
+        arkimePacket.ipOffset = packet->ipOffset;
+        arkimePacket.payloadOffset = packet->tcpOffset;
+        arkimePacket.payloadLen = tcpLen;
+        arkimePacket.direction = which;
+        arkimePacket.v6 = packet->v6;
+        tcpRawFunc(&jps->session, NULL, 0, &arkimePacket);
+    }
+
+    if (dataLen == 0 && (tcp->th_flags & (TH_ACK | TH_SYN | TH_FIN | TH_RST)) == TH_ACK)
+        jps->session.tcpFlagAckCnt[which]++;
+
+    // Only what was captured can be used
+    const uint8_t *payload = data + packet->tcpOffset + tcp->th_off * 4;
+    uint32_t       payloadLen = MIN(dataLen, packet->caplen - (packet->tcpOffset + tcp->th_off * 4));
+
+    if (tcp->th_flags & TH_SYN) {
+        jps->stream[which].nextSeq = ntohl(tcp->th_seq) + 1;
+        jps->stream[which].seqSet = 1;
+    } else if (dataLen > 0) {
+        if (!jps->ssh && !jps->stream[which].done) {
+            if (payloadLen < dataLen)
+                jp_stream_done(&jps->stream[which]);
+            else
+                jp_stream_add(jps, which, ntohl(tcp->th_seq), payload, payloadLen);
+        }
+
+        // Checked again since the version string that starts ssh is counted too
+        if (jps->ssh) {
+            SSHInfo_t *ssh = jps->ssh;
+            ssh->lens[which][ssh->packets200[which]++] = MIN(dataLen, 0xffff);
+            if (ssh->packets200[0] + ssh->packets200[1] == 200) {
+                sshFunc(&jps->session, NULL, 0, ssh);
+                ssh->packets200[0] = ssh->packets200[1] = 0;
+            }
+        }
+    }
+
+    if (tcp->th_flags & TH_RST)
+        jps->closing = 1;
+    if (tcp->th_flags & TH_FIN) {
+        jps->fin |= 1 << which;
+        if (jps->fin == 3)
+            jps->closing = 1;
+    }
+    jp_lru_append(worker, jps);
+}
+/******************************************************************************/
+/* End of the input, everything left is saved */
+void jp_worker_finish(int thread)
+{
+    JPWorker_t *worker = &workers[thread];
+
+    for (int closing = 0; closing < 2; closing++) {
+        while (worker->lruHead[closing])
+            jp_session_end(worker, worker->lruHead[closing]);
+    }
+
+    jp_output_flush(worker);
+}
+/******************************************************************************/
+void jp_worker_init(int thread)
+{
+    JPWorker_t *worker = &workers[thread];
+
+    if (!serverHelloFunc) {
+        serverHelloFunc = jp_named_func("tls_process_server_hello");
+        certificateFunc = jp_named_func("tls_process_certificate_wInfo");
+        sshFunc = jp_named_func("ssh_counting200");
+        tcpRawFunc = jp_named_func("tcp_raw_packet");
+    }
+
+    worker->mask = 0xffff;
+    worker->buckets = g_malloc0((worker->mask + 1) * sizeof(JPSession_t *));
+    worker->out = g_string_sized_new(JP_OUT_FLUSH + 4096);
+    worker->cell = g_string_sized_new(256);
+}
@@ -0,0 +1,74 @@
+#!/usr/bin/perl
+# ja4plus-db.pl -- compile a CSV of known fingerprints for ja4plusMatchDB
+#
+# Each line is type,fingerprint,label where type is one of ja4s, ja4x,
+# ja4h, ja4t or ja4ts. Blank lines and lines starting with # are skipped,
+# the label may be quoted and contain commas. If a fingerprint is listed
+# more than once the last label wins.
+#
+# The output is sorted by type and fingerprint so the same CSV always
+# builds the same file, the plugin builds its hash index at load. It is
+# written to a temp file and renamed, so a running capture never maps a
+# partial file.
+#
+# Usage: tools/ja4plus-db.pl fingerprints.csv ja4plus.db
+
+use strict;
+use warnings;
+
+my %types = (ja4s => 1, ja4x => 2, ja4h => 3, ja4t => 4, ja4ts => 5);
+
+die "Usage: $0 fingerprints.csv ja4plus.db\n" if (@ARGV != 2);
+my ($csv, $db) = @ARGV;
+
+my %entries;
+open(my $in, "<", $csv) or die "Can't open $csv: $!\n";
+while (my $line = <$in>) {
+    $line =~ s/\r?\n$//;
+    next if ($line =~ /^\s*(#|$)/);
+
+    my ($type, $fp, $label) = split(/,/, $line, 3);
+    die "$csv:$.: expected type,fingerprint,label\n" if (!defined $label);
+    $type = lc($type);
+    $type =~ s/^\s+|\s+$//g;
+    $fp =~ s/^\s+|\s+$//g;
+    $label =~ s/^\s+|\s+$//g;
+    $label = $1 if ($label =~ /^"(.*)"$/);
+    $label =~ s/""/"/g;
+
+    die "$csv:$.: unknown type $type\n" if (!exists $types{$type});
+    die "$csv:$.: empty fingerprint or label\n" if ($fp eq "" || $label eq "");
+    die "$csv:$.: fingerprint or label too long\n" if (length($fp) > 0xffff || length($label) > 0xffff);
+    $entries{"$types{$type},$fp"} = [$types{$type}, $fp, $label];
+}
+close($in);
+
+my @sorted = sort { $a->[0] <=> $b->[0] || $a->[1] cmp $b->[1] } values %entries;
+
+# Strings are shared, labels are NUL terminated for the tag
+my $strings = "";
+my %offsets;
+my $entries = "";
+foreach my $entry (@sorted) {
+    my ($type, $fp, $label) = @$entry;
+    foreach my $s ($fp, "$label\0") {
+        if (!exists $offsets{$s}) {
+            $offsets{$s} = length($strings);
+            $strings .= $s;
+        }
+    }
+    $entries .= pack("LLSSCx3", $offsets{$fp}, $offsets{"$label\0"}, length($fp), length($label), $type);
+}
+
+my $header = pack("a8LLLLLL", "JA4PDB1", 0x01020304, scalar(@sorted), 32, 32 + length($entries), length($strings), 0);
+
+{
+    use bytes;
+    open(my $out, ">", "$db.tmp") or die "Can't write $db.tmp: $!\n";
+    binmode($out);
+    print $out $header, $entries, $strings;
+    close($out) or die "Can't write $db.tmp: $!\n";
+}
+rename("$db.tmp", $db) or die "Can't rename $db.tmp to $db: $!\n";
+
+printf("%d fingerprints written to %s\n", scalar(@sorted), $db);